@@ -1,49 +1,35 @@
 #include <iostream>
-#include <fstream>
 #include <vector>
-#include <queue>
-#include <map>
-#include <functional>
-#include <cmath>
+#include <set>
+#include <unordered_map>
 #include <algorithm>
-#include <iomanip>
+#include <optional>
+#include <numeric>
+#include <thread>
+#include <atomic>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace std;
 
-static double are_close(const double a, const double b) {
-    return abs(a-b) < 5e-10;
-}
-
-#define M_2PI (M_PI * 2)
-
 class Asteroid {
 private:
     int _x, _y;
-    bool _destroyed;
 public:
-    Asteroid() : _x(0), _y(0), _destroyed(false) {
+    Asteroid() : _x(0), _y(0) {
     }
-    Asteroid(int x, int y): _x(x), _y(y), _destroyed(false) {
+    Asteroid(int x, int y): _x(x), _y(y) {
     }
     int x() const { return _x; }
     int y() const { return _y; }
-    void destroy() {
-        _destroyed = true;
-    }
-    bool is_destroyed() const {
-        return _destroyed;
-    }
-    const double angle_to(const Asteroid &asteroid) const {
-        return fmod(atan2(asteroid._y - _y, asteroid._x - _x) + M_PI_2 + M_2PI, M_2PI);
-    }
-    const double distance_to(const Asteroid &asteroid) const {
-        return sqrt(pow(abs(asteroid._y - _y), 2) + pow(abs(asteroid._x - _x), 2));
-    }
     ostream &operator<<(std::ostream &os) { 
         return os << _x << "," << _y;
     }
     bool operator==(const Asteroid &a) const {
-        return a._x == _x && a._y == _y && a._destroyed == _destroyed;
+        return a._x == _x && a._y == _y;
     }
     bool operator!=(const Asteroid &a) const {
         return !(a == *this);
@@ -56,12 +42,51 @@ std::ostream &operator<<(std::ostream &os, Asteroid const &asteroid) {
 }
 class AsteroidField {
 private:
-    vector<bool> _asteroidfield;
-    vector<Asteroid> _asteroids; 
-    int _width = 0, _height = 0;
+    vector<uint64_t> _bits;     // one bit per cell, rows padded to whole words
+    vector<int> _xs, _ys;       // asteroid coordinates in row major order
+    int _width = 0, _height = 0, _stride = 0;
+
+    static void set_bit(vector<uint64_t> &bits, size_t word, int x) {
+        bits[word] |= uint64_t(1) << (x & 63);
+    }
+
+    // One bit per '#' among 8 bytes, lowest byte first.
+    static uint64_t hashes_in(const char *p) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        const uint64_t low = 0x7f7f7f7f7f7f7f7full;
+        const auto x = word ^ 0x2323232323232323ull;
+        const auto zero = ~(((x & low) + low) | x | low);
+        return ((zero >> 7) * 0x0102040810204080ull) >> 56;
+    }
+
+    // Packs one row of the map into the bitmap and appends its asteroids.
+    void load_row(const char *p, int length) {
+        const auto row = (size_t)_height * _stride;
+        _bits.resize(row + _stride);
+        int x = 0;
+        for(; x + 8 <= length; x += 8) {
+            _bits[row + (x >> 6)] |= hashes_in(p + x) << (x & 63);
+        }
+        for(; x < length; x++) {
+            if(p[x] == '#') {
+                set_bit(_bits, row + (x >> 6), x);
+            }
+        }
+        for(int w = 0; w < _stride; w++) {
+            for(auto bits = _bits[row + w]; bits != 0; bits &= bits - 1) {
+                _xs.push_back(w * 64 + __builtin_ctzll(bits));
+                _ys.push_back(_height);
+            }
+        }
+        _height++;
+    }
 public:
+    // Above this many asteroids the occlusion bitmap beats hashing directions
+    static const size_t RAY_THRESHOLD = 4096;
+
     bool get(int x, int y) const {
-        return _asteroidfield[(y*_width)+x];
+        return (_bits[(size_t)y * _stride + (x >> 6)] >> (x & 63)) & 1;
     }
     int width() const {
         return _width;
@@ -69,90 +94,434 @@ public:
     int height() const {
         return _height;
     }
-    const vector<Asteroid> &asteroids() const {
-        return _asteroids;
+    size_t size() const {
+        return _xs.size();
     }
-    void sweep(const Asteroid &asteroid, vector<Asteroid> &others) {
-        copy_if(_asteroids.begin(), _asteroids.end(), back_inserter(others), [&asteroid](const Asteroid &a) {
-            return a != asteroid;
-        });
-        sort(others.begin(), others.end(), [&asteroid](const Asteroid &a, const Asteroid &b) {
-            const auto angle_a = asteroid.angle_to(a), angle_b = asteroid.angle_to(b);
-            if(are_close(angle_a, angle_b)) {
-                return asteroid.distance_to(a) < asteroid.distance_to(b); 
-            } else {
-                return angle_a < angle_b;
+    Asteroid asteroid(size_t i) const {
+        return Asteroid(_xs[i], _ys[i]);
+    }
+    const vector<int> &xs() const {
+        return _xs;
+    }
+    const vector<int> &ys() const {
+        return _ys;
+    }
+    // Asteroids seen from station: one per distinct direction, with offsets
+    // reduced by their gcd and collected in an open addressing hash set.
+    // `table` is scratch space reused between calls.
+    int visible_from(const Asteroid &station, vector<uint64_t> &table) const {
+        size_t capacity = 16;
+        while(capacity < _xs.size() * 2) {
+            capacity <<= 1;
+        }
+        table.assign(capacity, 0);
+        const int shift = 64 - __builtin_ctzll(capacity);
+        int seen = 0;
+        for(size_t i = 0; i < _xs.size(); i++) {
+            int dx = _xs[i] - station.x(), dy = _ys[i] - station.y();
+            if(dx == 0 && dy == 0) {
+                continue;
             }
-        });
+            const int g = gcd(dx, dy);
+            dx /= g;
+            dy /= g;
+            const uint64_t key = ((uint64_t)(uint32_t)dx << 32) | (uint32_t)dy;
+            for(size_t slot = (key * 0x9E3779B97F4A7C15ull) >> shift;; slot = (slot + 1) & (capacity - 1)) {
+                if(table[slot] == 0) {
+                    table[slot] = key;
+                    seen++;
+                    break;
+                }
+                if(table[slot] == key) {
+                    break;
+                }
+            }
+        }
+        return seen;
     }
-    AsteroidField(const string filename) {
-        auto file = ifstream(filename);
-        string line;
-        _asteroidfield = vector<bool>();
-        _asteroids = vector<Asteroid>();
-        while(getline(file, line)) {
-            int x = 0;
-            for(const auto &c: line) {
-                auto is_asteroid = c == '#';
-                _asteroidfield.push_back(is_asteroid);
-                if(is_asteroid) {
-                    _asteroids.push_back(Asteroid(x, _height));
+
+    // Asteroids seen from station by marking occlusion on a bitmap the size of
+    // the field. Rows are visited outwards from the station row, so along any
+    // ray the nearer asteroid is always met first. Each row is scanned 64
+    // cells at a time for asteroids not yet occluded, every such asteroid is
+    // visible and marks the cells further out along its ray. Occluded
+    // asteroids are skipped by the word masks and cost nothing.
+    int visible_by_rays(const Asteroid &station, vector<uint64_t> &occluded) const {
+        occluded.assign(_bits.size(), 0);
+        const int sx = station.x(), sy = station.y();
+        int seen = 0;
+        for(int x = sx - 1; x >= 0; x--) {
+            if(get(x, sy)) {
+                seen++;
+                break;
+            }
+        }
+        for(int x = sx + 1; x < _width; x++) {
+            if(get(x, sy)) {
+                seen++;
+                break;
+            }
+        }
+        for(int distance = 1; distance < max(sy + 1, _height - sy); distance++) {
+            for(const int y: {sy - distance, sy + distance}) {
+                if(y < 0 || y >= _height) {
+                    continue;
+                }
+                const int dy = y - sy;
+                const auto row = (size_t)y * _stride;
+                for(int w = 0; w < _stride; w++) {
+                    for(auto candidates = _bits[row + w] & ~occluded[row + w]; candidates != 0; candidates &= candidates - 1) {
+                        const int x = w * 64 + __builtin_ctzll(candidates);
+                        const int dx = x - sx, g = gcd(dx, dy);
+                        const int stepx = dx / g, stepy = dy / g;
+                        seen++;
+                        for(int rx = x + stepx, ry = y + stepy; rx >= 0 && rx < _width && ry >= 0 && ry < _height; rx += stepx, ry += stepy) {
+                            set_bit(occluded, (size_t)ry * _stride + (rx >> 6), rx);
+                        }
+                    }
                 }
-                x++;
             }
-            _width = line.length();
-            _height++;
         }
+        return seen;
+    }
+
+    // Asteroids seen from each asteroid, evaluated in parallel. Large fields
+    // use the bitmap kernel, small ones the direction hash.
+    vector<int> visible_counts() const {
+        vector<int> seen(_xs.size());
+        atomic<size_t> next(0);
+        vector<thread> workers;
+        for(unsigned t = 0; t < max(1u, thread::hardware_concurrency()); t++) {
+            workers.emplace_back([&]() {
+                vector<uint64_t> table;
+                vector<uint64_t> occluded;
+                for(auto i = next++; i < _xs.size(); i = next++) {
+                    seen[i] = _xs.size() > RAY_THRESHOLD
+                        ? visible_by_rays(asteroid(i), occluded)
+                        : visible_from(asteroid(i), table);
+                }
+            });
+        }
+        for(auto &worker: workers) {
+            worker.join();
+        }
+        return seen;
+    }
+
+    // First asteroid seeing the most others.
+    pair<Asteroid, int> best_station() const {
+        if(_xs.empty()) {
+            return {Asteroid(), 0};
+        }
+        const auto seen = visible_counts();
+        const auto best = max_element(seen.begin(), seen.end()) - seen.begin();
+        return {asteroid(best), seen[best]};
+    }
+
+    // Maps the file and packs it row by row, 8 cells per step, the width
+    // taken from the first line.
+    AsteroidField(const string filename) {
+        const int fd = open(filename.c_str(), O_RDONLY);
+        struct stat st;
+        if(fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0) {
+            if(fd >= 0) {
+                close(fd);
+            }
+            return;
+        }
+        const size_t size = st.st_size;
+        const auto data = (const char *)mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if(data == MAP_FAILED) {
+            return;
+        }
+        madvise((void *)data, size, MADV_SEQUENTIAL);
+        for(const char *p = data, *end = data + size; p < end;) {
+            auto eol = (const char *)memchr(p, '\n', end - p);
+            if(eol == nullptr) {
+                eol = end;
+            }
+            auto length = (int)(eol - p);
+            if(length > 0 && p[length - 1] == '\r') {
+                length--;
+            }
+            if(_height == 0) {
+                _width = length;
+                _stride = (_width + 63) / 64;
+            }
+            load_row(p, min(length, _width));
+            p = eol + 1;
+        }
+        munmap((void *)data, size);
     }
 };
 
 
-int main(int argc, char *argv[]) {
-    AsteroidField sf("aoc10.txt");
+// Targets around a station grouped by exact direction, the groups in the
+// order the laser reaches them (clockwise from straight up) and each sorted
+// nearest first. Rotation r vaporizes the r-th target of every group deeper
+// than r, which lets nth() jump straight to the right rotation.
+class Vaporizer {
+private:
+    vector<vector<Asteroid>> _groups;
+    vector<int> _sizes;
+    vector<long long> _prefix;
+    vector<int> _active;
+    size_t _rotation = 0, _cursor = 0;
 
-    Asteroid best_asteroid;
-    int best_asteroid_seen = -1;
-    optional<pair<Asteroid,int>> best_asteroid_count = {};
-    for(const auto &asteroid: sf.asteroids()) {
-        vector<Asteroid> others;
-        sf.sweep(asteroid, others);
-        double last_angle = -1;
-        int seen = 0;
-        for(const auto &relative: others) {
-            const auto angle = asteroid.angle_to(relative);
-            if(!are_close(angle, last_angle)) {
-                seen++;
+    // Targets vaporized during the first `rotations` rotations.
+    long long destroyed_within(long long rotations) const {
+        const auto deeper = lower_bound(_sizes.begin(), _sizes.end(), rotations) - _sizes.begin();
+        return _prefix[deeper] + (long long)(_sizes.size() - deeper) * rotations;
+    }
+
+public:
+    Vaporizer(const AsteroidField &field, const Asteroid &station) {
+        struct target {
+            int dx, dy, g;
+            Asteroid asteroid;
+        };
+        vector<target> targets;
+        for(size_t i = 0; i < field.size(); i++) {
+            const int dx = field.xs()[i] - station.x(), dy = field.ys()[i] - station.y();
+            if(dx != 0 || dy != 0) {
+                const int g = gcd(dx, dy);
+                targets.push_back({dx / g, dy / g, g, field.asteroid(i)});
             }
-            last_angle = angle;
         }
-        if(seen > best_asteroid_seen) {
-            best_asteroid = asteroid;
-            best_asteroid_seen = seen;
+        auto half = [](const target &t) {
+            return t.dx > 0 || (t.dx == 0 && t.dy < 0) ? 0 : 1;
+        };
+        sort(targets.begin(), targets.end(), [&half](const target &a, const target &b) {
+            if(half(a) != half(b)) {
+                return half(a) < half(b);
+            }
+            const long long cross = (long long)a.dx * b.dy - (long long)a.dy * b.dx;
+            return cross != 0 ? cross > 0 : a.g < b.g;
+        });
+        for(size_t i = 0; i < targets.size(); i++) {
+            if(i == 0 || targets[i].dx != targets[i - 1].dx || targets[i].dy != targets[i - 1].dy) {
+                _groups.push_back({});
+            }
+            _groups.back().push_back(targets[i].asteroid);
+        }
+        for(size_t i = 0; i < _groups.size(); i++) {
+            _sizes.push_back(_groups[i].size());
+            _active.push_back(i);
+        }
+        sort(_sizes.begin(), _sizes.end());
+        _prefix.push_back(0);
+        for(const auto size: _sizes) {
+            _prefix.push_back(_prefix.back() + size);
         }
     }
 
-    cout << "Best asteroid at " << best_asteroid << " with " 
-        << best_asteroid_seen << " others seen" << endl ;
+    // Yields the targets in the order they are vaporized.
+    bool next(Asteroid &asteroid) {
+        if(_cursor == _active.size()) {
+            _rotation++;
+            _cursor = 0;
+            _active.erase(remove_if(_active.begin(), _active.end(), [this](int group) {
+                return _groups[group].size() <= _rotation;
+            }), _active.end());
+        }
+        if(_active.empty()) {
+            return false;
+        }
+        asteroid = _groups[_active[_cursor++]][_rotation];
+        return true;
+    }
 
-    vector<Asteroid> others;
-    sf.sweep(best_asteroid, others);
-    int number_destroyed = 0;
-    while(number_destroyed < 200) {
-        double last_angle = -1;
-        for(auto &relative: others) {
-            if(!relative.is_destroyed()) {
-                const auto angle = best_asteroid.angle_to(relative);
-                if(!are_close(angle, last_angle)) {
-                    relative.destroy();
-                    number_destroyed++;
-                    if(number_destroyed == 200) {
-                        cout << "no " << number_destroyed << " is " << relative << endl;
-                    }
-                }
-                last_angle = angle;
+    // The k-th target vaporized, counting from 1.
+    optional<Asteroid> nth(long long k) const {
+        if(k < 1 || _sizes.empty() || k > _prefix.back()) {
+            return {};
+        }
+        long long lo = 0, hi = _sizes.back() - 1;
+        while(lo < hi) {
+            const auto mid = (lo + hi) / 2;
+            if(destroyed_within(mid + 1) >= k) {
+                hi = mid;
+            } else {
+                lo = mid + 1;
+            }
+        }
+        auto remaining = k - destroyed_within(lo);
+        for(const auto &group: _groups) {
+            if((long long)group.size() > lo && --remaining == 0) {
+                return group[lo];
+            }
+        }
+        return {};
+    }
+};
+
+// Keeps the number of asteroids seen from every asteroid up to date while
+// asteroids are removed and added. A changed cell only affects the stations
+// that see it, the nearest asteroid in each direction from it: such a station
+// loses (or gains) the cell but gains (or loses) the nearest asteroid behind
+// it, if there is one. Stations are kept ordered by count for best().
+class VisibilityIndex {
+private:
+    struct neighbour {
+        size_t index;
+        bool behind;    // another asteroid lies in the opposite direction
+    };
+    vector<int> _xs, _ys, _seen;
+    unordered_map<uint64_t, size_t> _slots;
+    set<pair<int, uint64_t>> _ranking;
+    vector<uint64_t> _keys;
+    vector<pair<int, size_t>> _nearest;
+
+    static uint64_t cell(int x, int y) {
+        return ((uint64_t)(uint32_t)y << 32) | (uint32_t)x;
+    }
+    static uint64_t direction(int dx, int dy) {
+        return ((uint64_t)(uint32_t)dx << 32) | (uint32_t)dy;
+    }
+
+    // The nearest asteroid in every direction from (x, y), with an open
+    // addressing table of directions holding the nearest distance so far.
+    vector<neighbour> neighbours(int x, int y) {
+        size_t capacity = 16;
+        while(capacity < _xs.size() * 2) {
+            capacity <<= 1;
+        }
+        _keys.assign(capacity, 0);
+        _nearest.resize(capacity);
+        const int shift = 64 - __builtin_ctzll(capacity);
+        auto find = [&](uint64_t key) {
+            auto slot = (key * 0x9E3779B97F4A7C15ull) >> shift;
+            while(_keys[slot] != 0 && _keys[slot] != key) {
+                slot = (slot + 1) & (capacity - 1);
+            }
+            return slot;
+        };
+        for(size_t i = 0; i < _xs.size(); i++) {
+            const int dx = _xs[i] - x, dy = _ys[i] - y;
+            if(dx == 0 && dy == 0) {
+                continue;
+            }
+            const int g = gcd(dx, dy);
+            const auto key = direction(dx / g, dy / g);
+            const auto slot = find(key);
+            if(_keys[slot] == 0 || g < _nearest[slot].first) {
+                _keys[slot] = key;
+                _nearest[slot] = {g, i};
+            }
+        }
+        vector<neighbour> result;
+        for(size_t slot = 0; slot < capacity; slot++) {
+            if(_keys[slot] != 0) {
+                const int dx = _keys[slot] >> 32, dy = (int)(uint32_t)_keys[slot];
+                result.push_back({_nearest[slot].second, _keys[find(direction(-dx, -dy))] != 0});
+            }
+        }
+        return result;
+    }
+
+    void adjust(size_t i, int delta) {
+        const auto key = cell(_xs[i], _ys[i]);
+        _ranking.erase({-_seen[i], key});
+        _seen[i] += delta;
+        _ranking.insert({-_seen[i], key});
+    }
+
+public:
+    VisibilityIndex(const AsteroidField &field) : _xs(field.xs()), _ys(field.ys()), _seen(field.visible_counts()) {
+        for(size_t i = 0; i < _xs.size(); i++) {
+            const auto key = cell(_xs[i], _ys[i]);
+            _slots[key] = i;
+            _ranking.insert({-_seen[i], key});
+        }
+    }
+
+    size_t size() const {
+        return _xs.size();
+    }
+
+    // Asteroids seen from the given one, -1 if there is none there.
+    int visible(const Asteroid &asteroid) const {
+        const auto found = _slots.find(cell(asteroid.x(), asteroid.y()));
+        return found == _slots.end() ? -1 : _seen[found->second];
+    }
+
+    // First asteroid in row major order seeing the most others.
+    pair<Asteroid, int> best() const {
+        if(_ranking.empty()) {
+            return {Asteroid(), 0};
+        }
+        const auto [seen, key] = *_ranking.begin();
+        return {Asteroid((int)(uint32_t)key, (int)(key >> 32)), -seen};
+    }
+
+    bool remove(const Asteroid &asteroid) {
+        const auto found = _slots.find(cell(asteroid.x(), asteroid.y()));
+        if(found == _slots.end()) {
+            return false;
+        }
+        const auto i = found->second, last = _xs.size() - 1;
+        _ranking.erase({-_seen[i], found->first});
+        _slots.erase(found);
+        if(i != last) {
+            _xs[i] = _xs[last];
+            _ys[i] = _ys[last];
+            _seen[i] = _seen[last];
+            _slots[cell(_xs[i], _ys[i])] = i;
+        }
+        _xs.pop_back();
+        _ys.pop_back();
+        _seen.pop_back();
+        for(const auto &n: neighbours(asteroid.x(), asteroid.y())) {
+            if(!n.behind) {
+                adjust(n.index, -1);
+            }
+        }
+        return true;
+    }
+
+    bool add(const Asteroid &asteroid) {
+        const auto key = cell(asteroid.x(), asteroid.y());
+        if(_slots.count(key) != 0) {
+            return false;
+        }
+        const auto seen = neighbours(asteroid.x(), asteroid.y());
+        for(const auto &n: seen) {
+            if(!n.behind) {
+                adjust(n.index, 1);
             }
         }
-    }    
+        _slots[key] = _xs.size();
+        _xs.push_back(asteroid.x());
+        _ys.push_back(asteroid.y());
+        _seen.push_back(seen.size());
+        _ranking.insert({-(int)seen.size(), key});
+        return true;
+    }
+};
+
+int main(int argc, char *argv[]) {
+    AsteroidField sf("aoc10.txt");
+
+    const auto [best_asteroid, best_asteroid_seen] = sf.best_station();
+
+    cout << "Best asteroid at " << best_asteroid << " with " 
+        << best_asteroid_seen << " others seen" << endl ;
+
+    const auto vaporized = Vaporizer(sf, best_asteroid).nth(200);
+    if(vaporized.has_value()) {
+        cout << "no 200 is " << vaporized.value() << endl;
+    }
+
+    VisibilityIndex index(sf);
+    Vaporizer vaporizer(sf, best_asteroid);
+    Asteroid target;
+    for(int i = 0; i < 200 && vaporizer.next(target); i++) {
+        index.remove(target);
+    }
+    const auto [after_asteroid, after_seen] = index.best();
+    cout << "After 200 vaporized best asteroid at " << after_asteroid << " with "
+        << after_seen << " others seen" << endl;
 
     cout << "Done!" << endl;
     return 0;
@@ -5,6 +5,23 @@
 #include <map>
 #include <functional>
 #include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <array>
+#include <optional>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+#include <memory>
 
 using namespace std;
 
@@ -17,6 +34,298 @@ enum STATE {
     HALT
 };
 
+// Hands out cache-line aligned blocks of VM memory carved from large arenas.
+// Released blocks go onto a free list per power-of-two size class so that
+// creating, resetting and destroying VMs never touches the global heap once
+// the pool is warm. Not thread safe.
+class MemoryPool {
+private:
+    static constexpr size_t CACHE_LINE = 64;
+    static constexpr size_t MIN_WORDS = CACHE_LINE / sizeof(long long);
+    static constexpr size_t ARENA_SIZE = 1 << 20;
+    static constexpr int SIZE_CLASSES = 48;
+
+    struct ArenaDeleter {
+        void operator()(char *p) const { free(p); }
+    };
+
+    vector<unique_ptr<char, ArenaDeleter>> _arenas;
+    array<vector<long long*>, SIZE_CLASSES> _free;
+    char *_next = nullptr, *_end = nullptr;
+    size_t _reserved = 0;
+
+    static int size_class(size_t words) {
+        int c = 0;
+        while(c < SIZE_CLASSES && (MIN_WORDS << c) < words) {
+            c++;
+        }
+        return c;
+    }
+
+    char *new_arena(size_t bytes) {
+        const auto size = max(bytes, ARENA_SIZE);
+        void *arena = nullptr;
+        if(posix_memalign(&arena, CACHE_LINE, size) != 0) {
+            throw bad_alloc();
+        }
+        _arenas.emplace_back(static_cast<char*>(arena));
+        _reserved += size;
+        return static_cast<char*>(arena);
+    }
+
+public:
+    static MemoryPool &shared() {
+        static MemoryPool pool;
+        return pool;
+    }
+
+    // Returns a block of at least `words` words, `capacity` receives the real size.
+    long long *allocate(size_t words, size_t &capacity) {
+        const auto c = size_class(words);
+        if(c >= SIZE_CLASSES) {
+            throw bad_alloc();
+        }
+        capacity = MIN_WORDS << c;
+        if(!_free[c].empty()) {
+            auto block = _free[c].back();
+            _free[c].pop_back();
+            return block;
+        }
+        const auto bytes = capacity * sizeof(long long);
+        if(bytes > ARENA_SIZE) {
+            return reinterpret_cast<long long*>(new_arena(bytes));
+        }
+        if(_next == nullptr || _end - _next < (ptrdiff_t)bytes) {
+            _next = new_arena(ARENA_SIZE);
+            _end = _next + ARENA_SIZE;
+        }
+        auto block = reinterpret_cast<long long*>(_next);
+        _next += bytes;
+        return block;
+    }
+
+    void release(long long *block, size_t capacity) {
+        if(block != nullptr) {
+            _free[size_class(capacity)].push_back(block);
+        }
+    }
+
+    size_t reserved_bytes() const {
+        return _reserved;
+    }
+};
+
+using ProgramImage = shared_ptr<const vector<long long>>;
+
+// Single producer, single consumer ring of Intcode values in a named POSIX
+// shared memory object. VMs in different processes exchange values through it
+// without copying through pipes; blocked readers and writers sleep on a futex.
+class SharedRing {
+private:
+    struct Header {
+        atomic<uint32_t> head;          // values written
+        atomic<uint32_t> tail;          // values read, writers wait on it
+        atomic<uint32_t> signal;        // bumped on push or close, readers wait on it
+        atomic<uint32_t> waiting_readers;
+        atomic<uint32_t> waiting_writers;
+        atomic<uint32_t> ready;         // READY once the creator has set up the header
+        atomic<uint32_t> closed;        // the writer is done
+        uint32_t capacity;              // power of two
+    };
+
+    static const uint32_t READY = 0x52494e47;
+
+    Header *_header;
+    long long *_slots;
+    size_t _bytes;
+    string _name;
+    bool _owner;
+
+    SharedRing(Header *header, size_t bytes, const string name, bool owner)
+        : _header(header), _slots(reinterpret_cast<long long*>(header + 1)),
+          _bytes(bytes), _name(name), _owner(owner) {
+    }
+
+    static size_t bytes_for(uint32_t capacity) {
+        return sizeof(Header) + capacity * sizeof(long long);
+    }
+
+    static void wait(atomic<uint32_t> &word, uint32_t value) {
+#ifdef __linux__
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, value, nullptr, nullptr, 0);
+#else
+        while(word.load() == value) {
+            this_thread::yield();
+        }
+#endif
+    }
+
+    static void wake(atomic<uint32_t> &word) {
+#ifdef __linux__
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#endif
+    }
+
+    // A reader either sees the new head or closed flag after registering as
+    // waiting, or is counted here and woken off the signal word.
+    void notify_readers() {
+        if(_header->waiting_readers.load(memory_order_seq_cst) > 0) {
+            _header->signal.fetch_add(1, memory_order_seq_cst);
+            wake(_header->signal);
+        }
+    }
+
+public:
+    SharedRing(const SharedRing &) = delete;
+    SharedRing &operator=(const SharedRing &) = delete;
+
+    ~SharedRing() {
+        munmap(_header, _bytes);
+        if(_owner) {
+            shm_unlink(_name.c_str());
+        }
+    }
+
+    // Creates the ring, the creating process unlinks the name when done.
+    static shared_ptr<SharedRing> create(const string name, uint32_t capacity) {
+        uint32_t rounded = 1;
+        while(rounded < capacity) {
+            rounded <<= 1;
+        }
+        const auto bytes = bytes_for(rounded);
+        auto fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if(fd == -1) {
+            return nullptr;
+        }
+        void *mem = MAP_FAILED;
+        if(ftruncate(fd, bytes) == 0) {
+            mem = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        ::close(fd);
+        if(mem == MAP_FAILED) {
+            shm_unlink(name.c_str());
+            return nullptr;
+        }
+        auto header = new (mem) Header();
+        header->capacity = rounded;
+        header->ready.store(READY, memory_order_release);
+        wake(header->ready);
+        return shared_ptr<SharedRing>(new SharedRing(header, bytes, name, true));
+    }
+
+    // Opens a ring made by create(), possibly still being set up by another
+    // process: the mapping is sized from the object once it has been resized
+    // and the header is only used after the creator has published READY.
+    static shared_ptr<SharedRing> open(const string name) {
+        auto fd = shm_open(name.c_str(), O_RDWR, 0600);
+        if(fd == -1) {
+            return nullptr;
+        }
+        struct stat st;
+        while(true) {
+            if(fstat(fd, &st) == -1) {
+                ::close(fd);
+                return nullptr;
+            }
+            if((size_t)st.st_size >= sizeof(Header)) {
+                break;
+            }
+            this_thread::yield();
+        }
+        const size_t bytes = st.st_size;
+        void *mem = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if(mem == MAP_FAILED) {
+            return nullptr;
+        }
+        auto header = static_cast<Header*>(mem);
+        while(header->ready.load(memory_order_acquire) != READY) {
+            wait(header->ready, 0);
+        }
+        if(bytes < bytes_for(header->capacity)) {
+            munmap(mem, bytes);
+            return nullptr;
+        }
+        return shared_ptr<SharedRing>(new SharedRing(header, bytes, name, false));
+    }
+
+    // Called by the writer when done, readers then drain what is left.
+    void close() {
+        _header->closed.store(1, memory_order_seq_cst);
+        notify_readers();
+    }
+
+    bool empty() const {
+        return _header->head.load(memory_order_acquire) == _header->tail.load(memory_order_relaxed);
+    }
+
+    bool try_push(long long value) {
+        const auto head = _header->head.load(memory_order_relaxed);
+        if(head - _header->tail.load(memory_order_acquire) == _header->capacity) {
+            return false;
+        }
+        _slots[head & (_header->capacity - 1)] = value;
+        _header->head.store(head + 1, memory_order_seq_cst);
+        notify_readers();
+        return true;
+    }
+
+    bool try_pop(long long &value) {
+        const auto tail = _header->tail.load(memory_order_relaxed);
+        if(_header->head.load(memory_order_acquire) == tail) {
+            return false;
+        }
+        value = _slots[tail & (_header->capacity - 1)];
+        _header->tail.store(tail + 1, memory_order_seq_cst);
+        if(_header->waiting_writers.load(memory_order_seq_cst) > 0) {
+            wake(_header->tail);
+        }
+        return true;
+    }
+
+    // Sleeps until a value is available, false if the ring was closed first.
+    bool wait_readable() {
+        while(true) {
+            const auto signal = _header->signal.load(memory_order_seq_cst);
+            _header->waiting_readers.fetch_add(1, memory_order_seq_cst);
+            const auto readable = _header->head.load(memory_order_seq_cst) != _header->tail.load(memory_order_relaxed);
+            const auto closed = _header->closed.load(memory_order_seq_cst) != 0;
+            if(!readable && !closed) {
+                wait(_header->signal, signal);
+            }
+            _header->waiting_readers.fetch_sub(1, memory_order_seq_cst);
+            if(readable || closed) {
+                return readable;
+            }
+        }
+    }
+
+    void push(long long value) {
+        while(!try_push(value)) {
+            const auto tail = _header->tail.load(memory_order_acquire);
+            _header->waiting_writers.fetch_add(1, memory_order_seq_cst);
+            if(_header->head.load(memory_order_relaxed) - tail == _header->capacity) {
+                wait(_header->tail, tail);
+            }
+            _header->waiting_writers.fetch_sub(1, memory_order_seq_cst);
+        }
+    }
+
+    long long pop() {
+        long long value;
+        return pop(value) ? value : 0;
+    }
+
+    bool pop(long long &value) {
+        while(!try_pop(value)) {
+            if(!wait_readable()) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
 class IntcodeComputer {
 private:
     enum OPCODE {
@@ -46,10 +355,30 @@ private:
             + (int)mode3 * 10000;
     }
 
-    inline void ensure_memory(const int addr) {
-        if(addr >= _memory.size()) {
-            _memory.resize(addr + 1, 0);
+    // Grows memory to cover addr, negative addresses stop the VM.
+    inline bool ensure_memory(const long long addr) {
+        if(addr < 0) {
+            cout << "ILLEGAL ADDRESS " << addr << endl;
+            _state = EXCEPTION;
+            return false;
+        }
+        if((size_t)addr >= _memory_size) {
+            grow_memory(addr + 1);
         }
+        return true;
+    }
+
+    void grow_memory(size_t size) {
+        if(size > _memory_capacity) {
+            size_t capacity;
+            auto block = MemoryPool::shared().allocate(max(size, _memory_capacity * 2), capacity);
+            copy(_memory, _memory + _memory_size, block);
+            fill(block + _memory_size, block + capacity, 0);
+            MemoryPool::shared().release(_memory, _memory_capacity);
+            _memory = block;
+            _memory_capacity = capacity;
+        }
+        _memory_size = size;
     }
 
     template<MODE mode, int i>
@@ -59,16 +388,16 @@ private:
             return p;
         }
         const auto addr = mode == RELATIVE ? _rel+p : p;
-        ensure_memory(addr);
-        return _memory[addr];        
+        return ensure_memory(addr) ? _memory[addr] : 0;
     }
 
     template<MODE mode, int i>
     inline void write(long long v) {
         const auto p = _memory[_pc+i];
         const auto addr = mode == RELATIVE ? _rel+p : p;
-        ensure_memory(addr);
-        _memory[addr] = v;
+        if(ensure_memory(addr)) {
+            _memory[addr] = v;
+        }
     }
 
     template<MODE mode1, MODE mode2, MODE mode3>
@@ -83,20 +412,23 @@ private:
         _pc += 4;
     }
 
-    template<MODE mode>
-    void op_in() {
-        if(_input.empty()) {
-            _state = WAIT_FOR_INPUT;
-        } else {
-            write<mode, 1>(_input.front());
-            _input.pop_front();
+    template<MODE mode, typename Ports>
+    void op_in(Ports &ports) {
+        long long value;
+        if(ports.input(value)) {
+            write<mode, 1>(value);
             _pc += 2;
+        } else {
+            _state = WAIT_FOR_INPUT;
         }
     }
 
-    template<MODE mode>
-    void op_out() {
-        _output.push_back(read<mode, 1>());
+    template<MODE mode, typename Ports>
+    void op_out(Ports &ports) {
+        const auto value = read<mode, 1>();
+        if(_state != EXCEPTION) {
+            ports.output(value);
+        }
         _pc += 2;
     }
 
@@ -142,23 +474,77 @@ private:
     }
 
     STATE _state;
-    vector<long long> _program, _memory;
+    ProgramImage _program;
+    long long *_memory = nullptr;
+    size_t _memory_size = 0, _memory_capacity = 0;
     deque<long long> _input, _output;
+    shared_ptr<SharedRing> _input_ring, _output_ring;
     int _pc, _rel;
+    long long _instructions;
+    bool _counting = false;
+
+    // Default ports, the host feeds and drains the VM through write() and read().
+    struct QueuePorts {
+        IntcodeComputer &computer;
+
+        bool input(long long &value) {
+            if(computer._input_ring) {
+                return computer._input_ring->try_pop(value);
+            }
+            if(computer._input.empty()) {
+                return false;
+            }
+            value = computer._input.front();
+            computer._input.pop_front();
+            return true;
+        }
+
+        void output(long long value) {
+            if(computer._output_ring) {
+                computer._output_ring->push(value);
+            } else {
+                computer._output.push_back(value);
+            }
+        }
+    };
 
 public:
     IntcodeComputer() {
     }
 
-    IntcodeComputer(vector<long long> &program) : _program(program) {
+    IntcodeComputer(vector<long long> &program) : _program(make_shared<const vector<long long>>(program)) {
         reset();
     }
 
+    IntcodeComputer(ProgramImage program) : _program(program) {
+        reset();
+    }
+
+    IntcodeComputer(const IntcodeComputer &) = delete;
+    IntcodeComputer &operator=(const IntcodeComputer &) = delete;
+
+    ~IntcodeComputer() {
+        MemoryPool::shared().release(_memory, _memory_capacity);
+    }
+
     void load(const string filename) {
-        load_program(filename, _program);
+        _program = load_image(filename);
         reset();
     }
 
+    // Loads each program file once and shares the read-only image between VMs.
+    static ProgramImage load_image(const string filename) {
+        static map<string, weak_ptr<const vector<long long>>> images;
+        auto image = images[filename].lock();
+        if(!image) {
+            auto program = make_shared<vector<long long>>();
+            load_program(filename, *program);
+            image = program;
+            images[filename] = image;
+        }
+        return image;
+    }
+
     static void load_program(const string filename, vector<long long> &program) {
         auto programfile = ifstream(filename);
         string instruction;
@@ -170,8 +556,8 @@ public:
     }
 
     void dump_memory() const {
-        for(auto const& i: _memory) {
-            cout << i << ",";
+        for(size_t i=0;i<_memory_size;i++) {
+            cout << _memory[i] << ",";
         }
         cout << endl;
     }
@@ -183,33 +569,72 @@ public:
         cout << endl;
     }
 
+    // Binds the IN/OUT ports to shared memory rings, nullptr unbinds.
+    void bind_input(shared_ptr<SharedRing> ring) {
+        _input_ring = ring;
+    }
+
+    void bind_output(shared_ptr<SharedRing> ring) {
+        _output_ring = ring;
+    }
+
     void write(long long value) {
-        _input.push_back(value);
+        if(_input_ring) {
+            _input_ring->push(value);
+        } else {
+            _input.push_back(value);
+        }
     }
 
     bool can_read() const {
+        if(_output_ring) {
+            return !_output_ring->empty();
+        }
         return _output.size() > 0;
     }
 
     long long read() {
+        if(_output_ring) {
+            return _output_ring->pop();
+        }
         if(_output.size() == 0) {
             cout << "WARNING: No output to read" << endl;
             return 0;
         }
-        int value = _output.front();
+        auto value = _output.front();
         _output.pop_front();
         return value;
     }
     void reset() {
-        _memory = _program;
-        _output = deque<long long>();
-        _input = deque<long long>();
+        const auto &program = *_program;
+        if(program.size() > _memory_capacity) {
+            MemoryPool::shared().release(_memory, _memory_capacity);
+            _memory = MemoryPool::shared().allocate(program.size(), _memory_capacity);
+            fill(_memory, _memory + _memory_capacity, 0);
+        } else {
+            fill(_memory + program.size(), _memory + max(_memory_size, program.size()), 0);
+        }
+        copy(program.begin(), program.end(), _memory);
+        _memory_size = program.size();
+        _output.clear();
+        _input.clear();
         _pc = _rel = 0;
+        _instructions = 0;
         _state = READY;
     }
     STATE state() const { 
         return _state;
     }
+    // Completed instructions since reset(), only counted when enabled.
+    void count_instructions(bool counting) {
+        _counting = counting;
+    }
+    long long instructions() const {
+        return _instructions;
+    }
+    size_t memory_size() const {
+        return _memory_size;
+    }
 
 #define CASE_INSTR(name, fn) \
     case make_instr<name>(): fn(); break;
@@ -223,6 +648,15 @@ public:
     case make_instr<name, POSITION>(): fn<POSITION>(); break; \
     case make_instr<name, RELATIVE>(): fn<RELATIVE>(); break;
 
+#define CASE_INSTR_R_PORTS(name, fn) \
+    case make_instr<name, POSITION>(): fn<POSITION>(ports); break; \
+    case make_instr<name, IMMEDIATE>(): fn<IMMEDIATE>(ports); break; \
+    case make_instr<name, RELATIVE>(): fn<RELATIVE>(ports); break;
+
+#define CASE_INSTR_W_PORTS(name, fn) \
+    case make_instr<name, POSITION>(): fn<POSITION>(ports); break; \
+    case make_instr<name, RELATIVE>(): fn<RELATIVE>(ports); break;
+
 #define _CASE_INSTR_RR_2(name, fn, p1mode) \
     case make_instr<name, p1mode, POSITION>(): fn<p1mode, POSITION>(); break; \
     case make_instr<name, p1mode, IMMEDIATE>(): fn<p1mode, IMMEDIATE>(); break; \
@@ -248,13 +682,31 @@ public:
     _CASE_INSTR_RRW_2(name, fn, RELATIVE)
 
     void run() {
+        QueuePorts ports = {*this};
+        run(ports);
+    }
+
+    // Runs with IN and OUT served inline by `ports`, which provides
+    // `bool input(long long &)` (false waits for input) and `void output(long long)`.
+    template<typename Ports>
+    void run(Ports &ports) {
+        if(_counting) {
+            execute<true>(ports);
+        } else {
+            execute<false>(ports);
+        }
+    }
+
+    // The dispatch loop, with the instruction counter compiled in or out.
+    template<bool counting, typename Ports>
+    void execute(Ports &ports) {
         _state = RUN;
         while(_state == RUN) {
             switch(_memory[_pc]) {
                 CASE_INSTR_RRW (OP_ADD, op_add)
                 CASE_INSTR_RRW (OP_MUL, op_mul)
-                CASE_INSTR_W   (OP_IN, op_in)
-                CASE_INSTR_R   (OP_OUT, op_out)
+                CASE_INSTR_W_PORTS (OP_IN, op_in)
+                CASE_INSTR_R_PORTS (OP_OUT, op_out)
                 CASE_INSTR_RR  (OP_JT, op_jt)
                 CASE_INSTR_RR  (OP_JF, op_jf)
                 CASE_INSTR_RRW (OP_LT, op_lt)
@@ -267,8 +719,138 @@ public:
                     _state = EXCEPTION;
                     return;
             }
+            if(counting && (_state == RUN || _state == HALT)) {
+                _instructions++;
+            }
+        }
+    }
+
+    // Runs until halt, sleeping on the bound input ring whenever it is empty.
+    void run_bound() {
+        run();
+        while(_state == WAIT_FOR_INPUT && _input_ring && _input_ring->wait_readable()) {
+            run();
+        }
+    }
+};
+
+// Unbounded 2D grid of bits stored as 64x64 bit-packed tiles in a directory
+// that doubles towards whichever side a new cell falls outside of. Each cell
+// has a color and a painted flag, painted cells are counted and bounded.
+class TiledGrid {
+private:
+    static constexpr int TILE_SHIFT = 6;
+    static constexpr int TILE_SIZE = 1 << TILE_SHIFT;
+
+    struct Tile {
+        array<uint64_t, TILE_SIZE> color = {}, painted = {};
+    };
+
+    vector<unique_ptr<Tile>> _tiles;
+    int _tx0 = 0, _ty0 = 0, _tw = 0, _th = 0;
+    size_t _painted = 0;
+    int _minx = INT_MAX, _miny = INT_MAX, _maxx = INT_MIN, _maxy = INT_MIN;
+
+    bool contains_tile(int tx, int ty) const {
+        return tx >= _tx0 && tx < _tx0 + _tw && ty >= _ty0 && ty < _ty0 + _th;
+    }
+
+    void grow(int tx, int ty) {
+        int x0 = _tx0, y0 = _ty0, w = _tw, h = _th;
+        if(w == 0) {
+            x0 = tx;
+            y0 = ty;
+            w = h = 1;
+        }
+        while(tx < x0) { x0 -= w; w *= 2; }
+        while(tx >= x0 + w) { w *= 2; }
+        while(ty < y0) { y0 -= h; h *= 2; }
+        while(ty >= y0 + h) { h *= 2; }
+
+        vector<unique_ptr<Tile>> tiles(w * h);
+        for(int y=0;y<_th;y++) {
+            for(int x=0;x<_tw;x++) {
+                tiles[(_ty0 + y - y0) * w + (_tx0 + x - x0)] = move(_tiles[y * _tw + x]);
+            }
+        }
+        _tiles = move(tiles);
+        _tx0 = x0;
+        _ty0 = y0;
+        _tw = w;
+        _th = h;
+    }
+
+    const Tile *find_tile(int x, int y) const {
+        const auto tx = x >> TILE_SHIFT, ty = y >> TILE_SHIFT;
+        return contains_tile(tx, ty) ? _tiles[(ty - _ty0) * _tw + (tx - _tx0)].get() : nullptr;
+    }
+
+    Tile *make_tile(int x, int y) {
+        const auto tx = x >> TILE_SHIFT, ty = y >> TILE_SHIFT;
+        if(!contains_tile(tx, ty)) {
+            grow(tx, ty);
+        }
+        auto &tile = _tiles[(ty - _ty0) * _tw + (tx - _tx0)];
+        if(!tile) {
+            tile = make_unique<Tile>();
         }
+        return tile.get();
     }
+
+public:
+    // Reference to one cell whose tile stays put while the grid grows.
+    class Cell {
+    private:
+        TiledGrid *_grid;
+        Tile *_tile;
+        int _x, _y;
+    public:
+        Cell(TiledGrid *grid, Tile *tile, int x, int y) : _grid(grid), _tile(tile), _x(x), _y(y) {
+        }
+        operator bool() const {
+            return (_tile->color[_y & (TILE_SIZE - 1)] >> (_x & (TILE_SIZE - 1))) & 1;
+        }
+        Cell &operator=(bool color) {
+            _grid->paint(_tile, _x, _y, color);
+            return *this;
+        }
+    };
+
+    Cell at(int x, int y) {
+        return Cell(this, make_tile(x, y), x, y);
+    }
+
+    bool get(int x, int y) const {
+        const auto tile = find_tile(x, y);
+        return tile != nullptr && ((tile->color[y & (TILE_SIZE - 1)] >> (x & (TILE_SIZE - 1))) & 1);
+    }
+
+    void set(int x, int y, bool color) {
+        paint(make_tile(x, y), x, y, color);
+    }
+
+    void paint(Tile *tile, int x, int y, bool color) {
+        const auto row = y & (TILE_SIZE - 1);
+        const auto bit = uint64_t(1) << (x & (TILE_SIZE - 1));
+        tile->color[row] = color ? tile->color[row] | bit : tile->color[row] & ~bit;
+        if((tile->painted[row] & bit) == 0) {
+            tile->painted[row] |= bit;
+            _painted++;
+            _minx = min(_minx, x);
+            _miny = min(_miny, y);
+            _maxx = max(_maxx, x);
+            _maxy = max(_maxy, y);
+        }
+    }
+
+    size_t painted() const {
+        return _painted;
+    }
+
+    int min_x() const { return _minx; }
+    int min_y() const { return _miny; }
+    int max_x() const { return _maxx; }
+    int max_y() const { return _maxy; }
 };
 
 enum Direction {
@@ -278,54 +860,324 @@ enum Direction {
     DirectionLeft
 };
 
-int main(int argc, char *argv[]) {
-    map<pair<int,int>,bool> hull = {
-        {make_pair(0,0), true}
+// Painter logic called straight from the VM's IN and OUT instructions. The
+// cell looked up for the camera is kept and painted on the following output.
+class HullPaintingRobot {
+private:
+    TiledGrid &_hull;
+    pair<int,int> _position = {};
+    Direction _direction = {};
+    optional<TiledGrid::Cell> _cell;
+    bool _painting = true;
+
+    TiledGrid::Cell &cell() {
+        if(!_cell) {
+            _cell = _hull.at(_position.first, _position.second);
+        }
+        return *_cell;
+    }
+
+public:
+    HullPaintingRobot(TiledGrid &hull) : _hull(hull) {
+    }
+
+    bool input(long long &value) {
+        value = cell() ? 1 : 0;
+        return true;
+    }
+
+    void output(long long value) {
+        if(_painting) {
+            cell() = value == 1;
+        } else {
+            _direction = (Direction)((_direction + (value ? 1 : 3)) % 4);
+            switch(_direction) {
+                case DirectionUp: _position.second--; break;
+                case DirectionRight: _position.first++; break;
+                case DirectionDown: _position.second++; break;
+                case DirectionLeft: _position.first--; break;
+            }
+            _cell.reset();
+        }
+        _painting = !_painting;
+    }
+};
+
+static void paint(IntcodeComputer &computer, TiledGrid &hull) {
+    HullPaintingRobot robot(hull);
+    computer.run(robot);
+}
+
+// Counts a cell up to n and outputs it.
+static vector<long long> loop_program(long long n) {
+    return {
+        1101,0,0,100,       // [100] = 0
+        1001,100,1,100,     // [100] += 1
+        1007,100,n,101,     // [101] = [100] < n
+        1005,101,4,         // if [101] goto 4
+        4,100,
+        99
     };
-    pair<int,int> position = {};
-    Direction direction = {};
+}
 
-    auto computer = IntcodeComputer();
-    computer.load("aoc11.txt");    
+// Writes n cells above the program through the relative base and sums them.
+static vector<long long> scan_program(long long n) {
+    return {
+        109,1000,           // rel = 1000
+        21001,200,7,0,      // [rel] = [200] + 7
+        201,0,201,201,      // [201] += [rel]
+        109,1,              // rel += 1
+        1001,200,1,200,     // [200] += 1
+        1007,200,n,202,     // [202] = [200] < n
+        1005,202,2,         // if [202] goto 2
+        4,201,
+        99
+    };
+}
+
+// Recursive sum(n) = n + sum(n-1) with one three word stack frame per call:
+// [rel] return address, [rel+1] n, [rel+2] result.
+static vector<long long> recursion_program(long long n) {
+    return {
+        109,100,            // rel = 100
+        21101,n,0,1,        // [rel+1] = n
+        21101,13,0,0,       // [rel] = 13
+        1105,1,16,          // call sum
+        204,2,
+        99,
+        1205,1,26,          // 16: sum, if n != 0 goto 26
+        21101,0,0,2,        // [rel+2] = 0
+        2105,1,0,           // return
+        21201,1,-1,4,       // 26: [rel+4] = n - 1
+        21101,39,0,3,       // [rel+3] = 39
+        109,3,
+        1105,1,16,          // call sum
+        109,-3,             // 39:
+        22201,1,5,2,        // [rel+2] = n + sum(n-1)
+        2105,1,0            // return
+    };
+}
+
+struct BenchmarkRun {
+    long long instructions = 0;
+    size_t memory = 0;
+
+    void add(const IntcodeComputer &computer) {
+        instructions += computer.instructions();
+        memory = max(memory, computer.memory_size() * sizeof(long long));
+    }
+};
+
+// `run` returns the workload's answer, checked against `expected`.
+struct Workload {
+    string name;
+    function<ProgramImage()> load;
+    function<long long(ProgramImage, BenchmarkRun&)> run;
+    long long expected;
+};
+
+static ProgramImage from_file(const string filename) {
+    auto program = make_shared<vector<long long>>();
+    IntcodeComputer::load_program(filename, *program);
+    return program;
+}
+
+// The last value output.
+static long long run_with_input(ProgramImage program, BenchmarkRun &result, long long input) {
+    IntcodeComputer computer(program);
+    computer.count_instructions(true);
+    computer.write(input);
     computer.run();
-    while(computer.state() == WAIT_FOR_INPUT) {
-        bool color = false;
-        if(hull.count(position) == 0) {
-            hull.insert({position, color});
-        } else {
-            color = hull[position];
+    result.add(computer);
+    long long output = 0;
+    while(computer.can_read()) {
+        output = computer.read();
+    }
+    return output;
+}
+
+// The highest signal of all phase settings.
+static long long run_amplifiers(ProgramImage program, BenchmarkRun &result) {
+    vector<unique_ptr<IntcodeComputer>> amplifiers;
+    for(int i=0;i<5;i++) {
+        amplifiers.push_back(make_unique<IntcodeComputer>(program));
+        amplifiers.back()->count_instructions(true);
+    }
+    vector<int> phases = {5,6,7,8,9};
+    long long highest = LLONG_MIN;
+    do {
+        long long signal = 0;
+        for(int i=0;i<5;i++) {
+            amplifiers[i]->reset();
+            amplifiers[i]->write(phases[i]);
+        }
+        while(amplifiers.back()->state() != HALT) {
+            for(auto &amplifier: amplifiers) {
+                amplifier->write(signal);
+                amplifier->run();
+                signal = amplifier->read();
+            }
+        }
+        for(auto &amplifier: amplifiers) {
+            result.add(*amplifier);
         }
+        highest = max(highest, signal);
+    } while(next_permutation(phases.begin(), phases.end()));
+    return highest;
+}
+
+// Runs every workload for at least min_seconds and reports one CSV row per workload.
+static int benchmark(double min_seconds) {
+    using clock = chrono::steady_clock;
+    const long long loops = 10000000, cells = 1000000, depth = 1000000;
+    const vector<Workload> workloads = {
+        {"aoc5", [] { return from_file("aoc5_program.txt"); },
+            [](ProgramImage p, BenchmarkRun &r) { return run_with_input(p, r, 5); }, 513116},
+        {"aoc7", [] { return from_file("aoc7.txt"); }, run_amplifiers, 1714298},
+        {"aoc9", [] { return from_file("aoc9.txt"); },
+            [](ProgramImage p, BenchmarkRun &r) { return run_with_input(p, r, 2); }, 58534},
+        {"aoc11", [] { return from_file("aoc11.txt"); },
+            [](ProgramImage p, BenchmarkRun &r) {
+                IntcodeComputer computer(p);
+                computer.count_instructions(true);
+                TiledGrid hull;
+                hull.set(0, 0, true);
+                paint(computer, hull);
+                r.add(computer);
+                return (long long)hull.painted();
+            }, 249},
+        {"loop", [=] { return make_shared<const vector<long long>>(loop_program(loops)); },
+            [](ProgramImage p, BenchmarkRun &r) { return run_with_input(p, r, 0); }, loops},
+        {"scan", [=] { return make_shared<const vector<long long>>(scan_program(cells)); },
+            [](ProgramImage p, BenchmarkRun &r) { return run_with_input(p, r, 0); },
+            cells * (cells - 1) / 2 + 7 * cells},
+        {"recursion", [=] { return make_shared<const vector<long long>>(recursion_program(depth)); },
+            [](ProgramImage p, BenchmarkRun &r) { return run_with_input(p, r, 0); },
+            depth * (depth + 1) / 2},
+    };
+
+    cout << "workload,runs,instructions,instructions_per_second,ns_per_instruction,"
+        << "memory_high_water_bytes,startup_ns" << endl;
+    for(const auto &workload: workloads) {
+        const auto load_start = clock::now();
+        auto program = workload.load();
+        { IntcodeComputer computer(program); }
+        const chrono::duration<double, nano> startup = clock::now() - load_start;
+
+        BenchmarkRun result;
+        int runs = 0;
+        chrono::duration<double> elapsed(0);
+        while(runs == 0 || elapsed.count() < min_seconds) {
+            const auto start = clock::now();
+            const auto answer = workload.run(program, result);
+            elapsed += clock::now() - start;
+            runs++;
+            if(answer != workload.expected) {
+                cout << "# " << workload.name << " answered " << answer << ", expected "
+                    << workload.expected << endl;
+                return 1;
+            }
+        }
+        const auto seconds = elapsed.count();
+        cout << workload.name << "," << runs << "," << result.instructions << ","
+            << (long long)(result.instructions / seconds) << ","
+            << seconds * 1e9 / result.instructions << ","
+            << result.memory << "," << (long long)startup.count() << endl;
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    cout << "# process max rss " << usage.ru_maxrss << ", pool reserved bytes "
+        << MemoryPool::shared().reserved_bytes() << endl;
+    return 0;
+}
 
-        computer.write(color ? 1 : 0);
-        computer.run();
+static void print_hull(const TiledGrid &hull) {
+    cout << "total painted:" << hull.painted() << endl;
 
-        hull[position] = computer.read() == 1;
-        auto newdirection = computer.read();
-        direction = (Direction)((direction + (newdirection ? 1 : 3)) % 4);
-        switch(direction) {
-            case DirectionUp: position = make_pair(position.first, position.second - 1); break;
-            case DirectionRight: position = make_pair(position.first + 1, position.second); break;
-            case DirectionDown: position = make_pair(position.first, position.second + 1); break;
-            case DirectionLeft: position = make_pair(position.first - 1, position.second); break;
+    string row;
+    for(int y=hull.min_y()-1;y<hull.max_y()+2;y++) {
+        row.clear();
+        for(int x=hull.min_x()-1;x<hull.max_x()+2;x++) {
+            row += hull.get(x, y) ? 'X' : ' ';
         }
+        cout << row << endl;
     }
+}
 
-    cout << "total painted:" << hull.size() << endl;
+static string ring_name(const string name, const string suffix) {
+    return (name[0] == '/' ? name : "/" + name) + "-" + suffix;
+}
 
-    int offsetx = INT_MAX, offsety = INT_MAX, limitx = INT_MIN, limity = INT_MIN;
-    for(const auto &p: hull) {
-        offsetx = min(p.first.first, offsetx);
-        offsety = min(p.first.second, offsety);
-        limitx = max(p.first.first, limitx);
-        limity = max(p.first.second, limity);
+// The painting program in this process, its robot in another one started
+// with --ring-consumer: camera values come in and paint and turn commands go
+// out through two shared memory rings.
+static int ring_producer(const string name) {
+    auto camera = SharedRing::create(ring_name(name, "camera"), 1024);
+    auto commands = SharedRing::create(ring_name(name, "commands"), 1024);
+    if(!camera || !commands) {
+        cout << "Can't create rings for " << name << endl;
+        return 1;
     }
+    IntcodeComputer computer;
+    computer.load("aoc11.txt");
+    computer.bind_input(camera);
+    computer.bind_output(commands);
+    computer.run_bound();
+    commands->close();
+    return computer.state() == HALT ? 0 : 1;
+}
 
-    for(int y=offsety-1;y<limity+2;y++) {
-        for(int x=offsetx-1;x<limitx+2;x++) {
-            cout << ((hull.count(make_pair(x,y)) > 0 && hull[make_pair(x,y)]) ? "X" : " ");
+static shared_ptr<SharedRing> open_ring(const string name) {
+    auto ring = SharedRing::open(name);
+    while(!ring) {
+        this_thread::sleep_for(chrono::milliseconds(1));
+        ring = SharedRing::open(name);
+    }
+    return ring;
+}
+
+// The robot for --ring-producer, waits for the producer to create the rings.
+static int ring_consumer(const string name) {
+    auto camera = open_ring(ring_name(name, "camera"));
+    auto commands = open_ring(ring_name(name, "commands"));
+    TiledGrid hull;
+    hull.set(0, 0, true);
+    HullPaintingRobot robot(hull);
+    while(true) {
+        long long color, paint, turn;
+        robot.input(color);
+        camera->push(color);
+        if(!commands->pop(paint) || !commands->pop(turn)) {
+            break;
         }
-        cout << endl;
+        robot.output(paint);
+        robot.output(turn);
+    }
+    print_hull(hull);
+    cout << "Done!" << endl;
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if(argc > 1 && string(argv[1]) == "--bench") {
+        return benchmark(argc > 2 ? stod(argv[2]) : 0.5);
     }
+    if(argc > 2 && string(argv[1]) == "--ring-producer") {
+        return ring_producer(argv[2]);
+    }
+    if(argc > 2 && string(argv[1]) == "--ring-consumer") {
+        return ring_consumer(argv[2]);
+    }
+
+    TiledGrid hull;
+    hull.set(0, 0, true);
+
+    auto computer = IntcodeComputer();
+    computer.load("aoc11.txt");    
+    paint(computer, hull);
+
+    print_hull(hull);
 
     cout << "Done!" << endl;
     return 0;
@@ -10,6 +10,7 @@
 #include <regex>
 #include <numeric>
 #include <array>
+#include <thread>
 
 using namespace std;
 
@@ -23,44 +24,90 @@ using namespace std;
 //     }
 // };
 
-class Moon {
-    int gravity(const int &first, const int &second) {
-        if(first == second) {
-            return 0;
-        } else {
-            return first > second ? -1 : 1;
-        }
-    }
-    array<int, 3> _position, _velocity;
+// The moons stored axis by axis. Axes never interact, so each one is a
+// separate system of positions and velocities that can be stepped on its own
+// in loops the compiler vectorizes across moons.
+class MoonSystem {
+    array<vector<int>, 3> _position, _velocity;
 public:
-    Moon(int x, int y, int z) : _position({x,y,z}), _velocity({}) {
-    }
-    const array<int, 3> &position() const{
-        return _position;
+    // Gravity and velocity for one axis. Each other moon pulls by the sign of
+    // the difference, computed with compares instead of branches.
+    static void step(int *__restrict position, int *__restrict velocity, size_t count) {
+        for(size_t j = 0; j < count; j++) {
+            const int other = position[j];
+            for(size_t i = 0; i < count; i++) {
+                velocity[i] += (other > position[i]) - (other < position[i]);
+            }
+        }
+        for(size_t i = 0; i < count; i++) {
+            position[i] += velocity[i];
+        }
     }
-    const array<int, 3> &velocity() const {
-        return _velocity;
+
+    // Steps until the axis is back at its starting positions with zero
+    // velocities. Stepping is reversible, so the first state to come back is
+    // the starting one.
+    static long long cycle(vector<int> position, vector<int> velocity) {
+        const auto initial = position, still = velocity;
+        const auto count = position.size();
+        for(long long steps = 1;; steps++) {
+            step(position.data(), velocity.data(), count);
+            int differs = 0;
+            for(size_t i = 0; i < count; i++) {
+                differs |= (position[i] ^ initial[i]) | (velocity[i] ^ still[i]);
+            }
+            if(differs == 0) {
+                return steps;
+            }
+        }
     }
-    void apply_gravity(const Moon &other) {
+
+    void add(int x, int y, int z) {
+        const array<int, 3> position = {x, y, z};
         for(int i=0; i<3; i++) {
-            _velocity[i] += gravity(_position[i], other._position[i]);
+            _position[i].push_back(position[i]);
+            _velocity[i].push_back(0);
         }
     }
+    size_t size() const {
+        return _position[0].size();
+    }
+    array<int, 3> position(size_t moon) const {
+        return {_position[0][moon], _position[1][moon], _position[2][moon]};
+    }
+    array<int, 3> velocity(size_t moon) const {
+        return {_velocity[0][moon], _velocity[1][moon], _velocity[2][moon]};
+    }
     void step() {
         for(int i=0; i<3; i++) {
-            _position[i] += _velocity[i];
+            step(_position[i].data(), _velocity[i].data(), size());
         }
     }
-    int energy() const {
-        int potential = 0, kinetic = 0;
+    // Cycle length of each axis, the axes searched in parallel.
+    array<long long, 3> cycles() const {
+        array<long long, 3> cycles;
+        vector<thread> workers;
         for(int i=0; i<3; i++) {
-            potential += abs(_position[i]);
-            kinetic += abs(_velocity[i]);
+            workers.emplace_back([this, &cycles, i]() {
+                cycles[i] = cycle(_position[i], _velocity[i]);
+            });
         }
-        return potential * kinetic;
+        for(auto &worker: workers) {
+            worker.join();
+        }
+        return cycles;
     }
-    bool operator==(const Moon &other) const {
-        return _position == other._position && _velocity == other._velocity;
+    int energy() const {
+        int total = 0;
+        for(size_t moon = 0; moon < size(); moon++) {
+            int potential = 0, kinetic = 0;
+            for(int i=0; i<3; i++) {
+                potential += abs(_position[i][moon]);
+                kinetic += abs(_velocity[i][moon]);
+            }
+            total += potential * kinetic;
+        }
+        return total;
     }
 };
 
@@ -69,73 +116,32 @@ ostream &operator<<(ostream &str, const array<int, 3> &v) {
     return str;
 }
 
-ostream &operator<<(ostream &str, const Moon &moon) {
-    str << "pos=" << moon.position() << ", vel=" << moon.velocity();
-    return str;
-}
-
-static void load(const string filename, vector<Moon> &moons) {
+static void load(const string filename, MoonSystem &moons) {
     auto file = ifstream(filename);
     string line;
     regex pattern("<x=([-0-9]+), y=([-0-9]+), z=([-0-9]+)>");
     while(getline(file, line)) {
         smatch matches;
         if(regex_match(line, matches, pattern)) {
-            moons.push_back(Moon(stoi(matches[1]), stoi(matches[2]), stoi(matches[3])));    
+            moons.add(stoi(matches[1]), stoi(matches[2]), stoi(matches[3]));
         }
     }
 }
 
-int energy(const vector<Moon> &moons) {
-    return reduce(moons.begin(), moons.end(), 0, [](int sum, const Moon &moon) {
-        return sum + moon.energy();
-    });
-}
-
-
-void dump(const vector<Moon> &moons, const long &step) {
+void dump(const MoonSystem &moons, const long &step) {
     cout << "After " << step << " steps:" << endl;
-    for(const auto &moon: moons) {
-        cout << moon << endl;
+    for(size_t moon = 0; moon < moons.size(); moon++) {
+        cout << "pos=" << moons.position(moon) << ", vel=" << moons.velocity(moon) << endl;
     }
-    cout << "Energy: " << energy(moons) << endl << endl;
+    cout << "Energy: " << moons.energy() << endl << endl;
 }
 
 int main(int argc, char *argv[]) {
-    vector<Moon> moons = {};
+    MoonSystem moons;
     load("aoc12.txt", moons);
-    auto initial = moons;
-    array<long long, 3> cycles = {-1, -1, -1};
-    // const array<string, 3> dims = {"x", "y", "z"};
-    const long max_steps = 3000;
 
     // dump(moons, 0);
-    for(long step=0; cycles[0] == -1 || cycles[1] == -1 || cycles[2] == -1; step++) {
-        for(int first=0; first<moons.size(); first++) {
-            for(int second=first+1; second<moons.size(); second++) {
-                moons[first].apply_gravity(moons[second]);
-                moons[second].apply_gravity(moons[first]);
-            }
-        }
-        for(auto &moon: moons) {
-            moon.step();
-        }
-
-        // dump(moons, step+1);
-        array<bool, 3> has_cycle = {true, true, true};
-        for(int moon=0; moon<moons.size(); moon++) {
-            for(int i=0; i<3; i++) {
-                has_cycle[i] = has_cycle[i] 
-                    && initial[moon].position()[i] == moons[moon].position()[i] 
-                    && moons[moon].velocity()[i] == 0;
-            }
-        }
-        for(int i=0; i<3; i++) {
-            if(has_cycle[i]) {
-                cycles[i] = (cycles[i] == -1 ? step+1 : cycles[i]);
-            }
-        }
-    }
+    const auto cycles = moons.cycles();
 
     cout << "cycles=<x=" << cycles[0] << ", y=" << cycles[1] << ", z=" << cycles[2] << ">" << endl;
     cout << "comon cycle at: " << lcm(lcm(cycles[0], cycles[1]), lcm(cycles[1], cycles[2])) << endl;
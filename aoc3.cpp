@@ -1,8 +1,19 @@
 #include <iostream>
 #include <fstream>
 #include <vector>
-#include <sstream>
+#include <iomanip>
 #include <optional>
+#include <set>
+#include <map>
+#include <climits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <algorithm>
 
 using namespace std;
 
@@ -44,7 +55,7 @@ public:
 //    point end() const {
 //        return end;
 //    }
-    direction direction() const {
+    ::direction direction() const {
         if(start.x == end.x) {
             return VERTICAL;
         } else {
@@ -84,14 +95,24 @@ public:
     }
 };
 
-void parselines(vector<line> &lines, string input) {
+// Parses one wire from [p, end) up to the end of the line, calling fn with each
+// segment as soon as its command has been read. Returns where parsing stopped.
+template<typename F>
+const char *parsecommands(const char *p, const char *end, F fn) {
     auto position = point();
     int totallength = 0;
-    stringstream is(input);
-    string command;
-    while(getline(is, command, ',')) {
-        char direction = command[0];
-        int distance = stoi(command.substr(1));
+    while(p < end && *p != '\n') {
+        const char direction = *p++;
+        int distance = 0;
+        while(p < end && *p >= '0' && *p <= '9') {
+            distance = distance * 10 + (*p++ - '0');
+        }
+        while(p < end && *p != ',' && *p != '\n') {
+            p++;
+        }
+        if(p < end && *p == ',') {
+            p++;
+        }
         auto origin = position;
         switch(direction) {
             case 'U':
@@ -106,45 +127,358 @@ void parselines(vector<line> &lines, string input) {
             case 'L':
                 position.x -= distance;
                 break;
+            default:
+                continue;
         }
-        lines.push_back(line(origin, position, totallength));
+        fn(line(origin, position, totallength));
         totallength += distance;
     }
+    return p < end ? p + 1 : p;
 }
 
-optional<int> findintersection(vector<line> &wire1, vector<line> &wire2) {
-    auto shortestlength = optional<int>();
-    for(auto const &seg1: wire1) {
-        for(auto const &seg2: wire2) {
+void parselines(vector<line> &lines, const string &input) {
+    parsecommands(input.data(), input.data() + input.size(), [&lines](const line &seg) {
+        lines.push_back(seg);
+    });
+}
+
+struct intersections {
+    optional<point> closest;
+    optional<int> steps;
+
+    void add(const point &p, int length) {
+        if(!closest.has_value() || p.manhattan_distance() < closest->manhattan_distance()) {
+            closest = p;
+        }
+        steps = steps.has_value() ? min(steps.value(), length) : length;
+    }
+};
+
+// The segments of one wire sorted the ways the sweep consumes them. Built
+// once per wire and shared read-only by every pair the wire takes part in.
+struct sweep_index {
+    vector<const line*> horizontals_by_start, horizontals_by_end, verticals;
+
+    explicit sweep_index(const vector<line> &wire) {
+        for(auto const &seg: wire) {
+            if(seg.direction() == HORIZONTAL) {
+                horizontals_by_start.push_back(&seg);
+            } else {
+                verticals.push_back(&seg);
+            }
+        }
+        horizontals_by_end = horizontals_by_start;
+        sort(horizontals_by_start.begin(), horizontals_by_start.end(), [](const line *a, const line *b) {
+            return a->start.x < b->start.x;
+        });
+        sort(horizontals_by_end.begin(), horizontals_by_end.end(), [](const line *a, const line *b) {
+            return a->end.x < b->end.x;
+        });
+        sort(verticals.begin(), verticals.end(), [](const line *a, const line *b) {
+            return a->start.x < b->start.x;
+        });
+    }
+};
+
+// Sweeps across x keeping the horizontal segments of one wire that span the
+// sweep position ordered by y, each vertical segment of the other wire then
+// only visits the active segments inside its own y range.
+void sweep(const sweep_index &hwire, const sweep_index &vwire, intersections &result) {
+    auto const &starts = hwire.horizontals_by_start, &ends = hwire.horizontals_by_end;
+    auto const &verticals = vwire.verticals;
+    set<pair<int, const line*>> active;
+    size_t s = 0, e = 0;
+    for(auto const v: verticals) {
+        const auto x = v->start.x;
+        for(; s < starts.size() && starts[s]->start.x <= x; s++) {
+            active.insert({starts[s]->start.y, starts[s]});
+        }
+        for(; e < ends.size() && ends[e]->end.x < x; e++) {
+            active.erase({ends[e]->start.y, ends[e]});
+        }
+        for(auto it = active.lower_bound({v->start.y, nullptr}); it != active.end() && it->first <= v->end.y; ++it) {
             point intersection;
             int length;
-            if(seg1.intersects(seg2, intersection, length) && !intersection.is_origin()) {
-                cout << "Intersection at " << intersection.x << "," <<intersection.y << endl;
-                if(shortestlength.has_value()) {
-                    shortestlength = min(shortestlength.value(), length);
-                }
-                else {
-                    shortestlength = length;
-                }
+            if(line::intersects_hv(*it->second, *v, intersection, length) && !intersection.is_origin()) {
+                result.add(intersection, length);
+            }
+        }
+    }
+}
+
+intersections findintersection(const sweep_index &wire1, const sweep_index &wire2) {
+    intersections result;
+    sweep(wire1, wire2, result);
+    sweep(wire2, wire1, result);
+    return result;
+}
+
+intersections findintersection(const vector<line> &wire1, const vector<line> &wire2) {
+    return findintersection(sweep_index(wire1), sweep_index(wire2));
+}
+
+// Persistent lookup structure for one wire. Horizontal segments are grouped by
+// row and vertical ones by column, each group sorted by start with a running
+// maximum of the ends, so a scan back from the query position stops as soon
+// as no earlier segment can reach it.
+class wire_index {
+private:
+    struct group {
+        vector<const line*> segments;
+        vector<int> reach;
+    };
+    map<int, group> _rows, _columns;
+
+    static void build(map<int, group> &groups, bool horizontal) {
+        for(auto &[key, g]: groups) {
+            sort(g.segments.begin(), g.segments.end(), [horizontal](const line *a, const line *b) {
+                return horizontal ? a->start.x < b->start.x : a->start.y < b->start.y;
+            });
+            int reach = INT_MIN;
+            for(auto const seg: g.segments) {
+                reach = max(reach, horizontal ? seg->end.x : seg->end.y);
+                g.reach.push_back(reach);
+            }
+        }
+    }
+
+    // Calls fn for every segment in the group overlapping [from, to] along the group's axis.
+    template<typename F>
+    static void scan(const group &g, bool horizontal, int from, int to, F fn) {
+        auto it = upper_bound(g.segments.begin(), g.segments.end(), to, [horizontal](int v, const line *seg) {
+            return v < (horizontal ? seg->start.x : seg->start.y);
+        });
+        for(auto i = it - g.segments.begin() - 1; i >= 0 && g.reach[i] >= from; i--) {
+            const auto seg = g.segments[i];
+            if((horizontal ? seg->end.x : seg->end.y) >= from) {
+                fn(seg);
+            }
+        }
+    }
+
+public:
+    explicit wire_index(const vector<line> &wire) {
+        for(auto const &seg: wire) {
+            if(seg.direction() == HORIZONTAL) {
+                _rows[seg.start.y].segments.push_back(&seg);
+            } else {
+                _columns[seg.start.x].segments.push_back(&seg);
+            }
+        }
+        build(_rows, true);
+        build(_columns, false);
+    }
+
+    // Steps along the wire to the first visit of p, if the wire passes p at all.
+    optional<int> steps_to(const point &p) const {
+        optional<int> steps;
+        auto visit = [&](const line *seg) {
+            const auto offset = seg->direction() == HORIZONTAL
+                ? (!seg->flipped ? p.x - seg->start.x : seg->end.x - p.x)
+                : (!seg->flipped ? p.y - seg->start.y : seg->end.y - p.y);
+            steps = steps.has_value() ? min(steps.value(), seg->distance + offset) : seg->distance + offset;
+        };
+        if(auto row = _rows.find(p.y); row != _rows.end()) {
+            scan(row->second, true, p.x, p.x, visit);
+        }
+        if(auto column = _columns.find(p.x); column != _columns.end()) {
+            scan(column->second, false, p.y, p.y, visit);
+        }
+        return steps;
+    }
+
+    // Appends every segment touching the rectangle [lower, upper], corners
+    // inclusive. Every row and column key inside the rectangle is visited, so
+    // the cost grows with the rectangle's height and width as well as the hits.
+    void query(const point &lower, const point &upper, vector<const line*> &segments) const {
+        auto add = [&segments](const line *seg) {
+            segments.push_back(seg);
+        };
+        for(auto row = _rows.lower_bound(lower.y); row != _rows.end() && row->first <= upper.y; ++row) {
+            scan(row->second, true, lower.x, upper.x, add);
+        }
+        for(auto column = _columns.lower_bound(lower.x); column != _columns.end() && column->first <= upper.x; ++column) {
+            scan(column->second, false, lower.y, upper.y, add);
+        }
+    }
+};
+
+// Indexes the first wire of a memory mapped file, then parses the second one
+// command by command and checks each segment against the index as it is read,
+// so only the first wire is ever held in memory.
+optional<intersections> streamintersection(const string filename) {
+    auto fd = open(filename.c_str(), O_RDONLY);
+    if(fd == -1) {
+        return {};
+    }
+    struct stat st;
+    if(fstat(fd, &st) == -1 || st.st_size == 0) {
+        close(fd);
+        return {};
+    }
+    auto data = static_cast<const char*>(mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0));
+    close(fd);
+    if(data == MAP_FAILED) {
+        return {};
+    }
+    madvise(const_cast<char*>(data), st.st_size, MADV_SEQUENTIAL);
+    const auto end = data + st.st_size;
+
+    vector<line> wire1;
+    auto p = parsecommands(data, end, [&wire1](const line &seg) {
+        wire1.push_back(seg);
+    });
+    const wire_index index(wire1);
+
+    intersections result;
+    vector<const line*> candidates;
+    parsecommands(p, end, [&](const line &seg2) {
+        candidates.clear();
+        index.query(seg2.start, seg2.end, candidates);
+        for(auto const seg1: candidates) {
+            point intersection;
+            int length;
+            if(seg1->intersects(seg2, intersection, length) && !intersection.is_origin()) {
+                result.add(intersection, length);
+            }
+        }
+    });
+    munmap(const_cast<char*>(data), st.st_size);
+    return result;
+}
+
+template<typename F>
+void parallel_for(size_t count, F fn) {
+    atomic<size_t> next(0);
+    vector<thread> workers;
+    const auto n = max(1u, thread::hardware_concurrency());
+    for(unsigned t = 0; t < n; t++) {
+        workers.emplace_back([&]() {
+            for(size_t i = next++; i < count; i = next++) {
+                fn(i);
             }
+        });
+    }
+    for(auto &worker: workers) {
+        worker.join();
+    }
+}
+
+// Crossings for every pair of wires, row i column j holds wire i against wire j.
+vector<vector<intersections>> findintersections(const vector<vector<line>> &wires) {
+    vector<unique_ptr<sweep_index>> indexes(wires.size());
+    parallel_for(wires.size(), [&](size_t i) {
+        indexes[i] = make_unique<sweep_index>(wires[i]);
+    });
+
+    vector<pair<size_t, size_t>> pairs;
+    for(size_t i = 0; i < wires.size(); i++) {
+        for(size_t j = i + 1; j < wires.size(); j++) {
+            pairs.push_back({i, j});
         }
     }
-    return shortestlength;
+    auto matrix = vector<vector<intersections>>(wires.size(), vector<intersections>(wires.size()));
+    parallel_for(pairs.size(), [&](size_t p) {
+        auto [i, j] = pairs[p];
+        matrix[i][j] = matrix[j][i] = findintersection(*indexes[i], *indexes[j]);
+    });
+    return matrix;
+}
+
+// Steps along the first wire of wirefile to each "x,y" point in pointfile.
+int printsteps(const string wirefile, const string pointfile) {
+    auto file = ifstream(wirefile);
+    string input;
+    if(!getline(file, input)) {
+        cout << "Could not read input" << endl;
+        return 1;
+    }
+    vector<line> wire;
+    parselines(wire, input);
+    const wire_index index(wire);
+
+    auto points = ifstream(pointfile);
+    point p;
+    char separator;
+    while(points >> p.x >> separator >> p.y) {
+        const auto steps = index.steps_to(p);
+        cout << p.x << "," << p.y << " ";
+        if(steps.has_value()) {
+            cout << steps.value() << endl;
+        } else {
+            cout << "-" << endl;
+        }
+    }
+    return 0;
 }
 
 int main(int argc, char *argv[]) {
-    auto file = ifstream("aoc3_easy.txt");
-    string input1, input2;
-    getline(file, input1);
-    getline(file, input2);
-
-    vector<line> wire1, wire2;
-    parselines(wire1, input1);
-    parselines(wire2, input2);
-
-    auto steps = findintersection(wire1, wire2);
-    if(steps.has_value()) {
-        cout << "Minimum steps " << steps.value() << endl;
+    if(argc > 3 && string(argv[1]) == "--points") {
+        return printsteps(argv[2], argv[3]);
+    }
+    if(argc > 1 && string(argv[1]) == "--stream") {
+        auto result = streamintersection(argc > 2 ? argv[2] : "aoc3_easy.txt");
+        if(!result.has_value()) {
+            cout << "Could not read input" << endl;
+            return 1;
+        }
+        if(result->closest.has_value()) {
+            cout << "Closest intersection at " << result->closest->x << "," << result->closest->y
+                << " distance " << result->closest->manhattan_distance() << endl;
+            cout << "Minimum steps " << result->steps.value() << endl;
+        } else {
+            cout << "No intersection" << endl;
+        }
+        cout << "Done!" << endl;
+        return 0;
+    }
+
+    auto file = ifstream(argc > 1 ? argv[1] : "aoc3_easy.txt");
+    vector<vector<line>> wires;
+    string input;
+    while(getline(file, input)) {
+        if(!input.empty()) {
+            wires.push_back(vector<line>());
+            parselines(wires.back(), input);
+        }
+    }
+
+    if(wires.size() > 2) {
+        auto matrix = findintersections(wires);
+        optional<int> closest, steps;
+        for(size_t i = 0; i < wires.size(); i++) {
+            for(size_t j = 0; j < wires.size(); j++) {
+                const auto &result = matrix[i][j];
+                if(result.closest.has_value()) {
+                    const auto distance = result.closest->manhattan_distance();
+                    closest = closest.has_value() ? min(closest.value(), distance) : distance;
+                    steps = steps.has_value() ? min(steps.value(), result.steps.value()) : result.steps.value();
+                    cout << setw(8) << distance;
+                } else {
+                    cout << setw(8) << "-";
+                }
+            }
+            cout << endl;
+        }
+        if(closest.has_value()) {
+            cout << "Closest distance " << closest.value() << endl;
+            cout << "Minimum steps " << steps.value() << endl;
+        } else {
+            cout << "No intersection" << endl;
+        }
+        cout << "Done!" << endl;
+        return 0;
+    }
+    if(wires.size() < 2) {
+        cout << "Need at least two wires" << endl;
+        return 1;
+    }
+
+    auto result = findintersection(wires[0], wires[1]);
+    if(result.closest.has_value()) {
+        cout << "Closest intersection at " << result.closest->x << "," << result.closest->y
+            << " distance " << result.closest->manhattan_distance() << endl;
+        cout << "Minimum steps " << result.steps.value() << endl;
     } else {
         cout << "No intersection" << endl;
     }
@@ -1,33 +1,237 @@
 #include <iostream>
 #include <fstream>
 #include <vector>
-#include <sstream>
-#include <optional>
+#include <array>
+#include <string>
+#include <thread>
+#include <chrono>
 
 using namespace std;
 
+enum rule {
+    ADJACENT_PAIR,  // two adjacent digits are the same
+    EXACT_PAIR      // a group of equal adjacent digits is exactly two long
+};
 
-int main(int argc, char *argv[]) {
-    //264793-803935
-    int matches = 0;
-    for(int p = 264793;p<=803935;p++) {
-        string s = to_string(p);
-        // two adjacent
-        if(!((s[0] == s[1] && s[1] != s[2])
-            || (s[1] == s[2] && s[0] != s[1] && s[3] != s[1])
-            || (s[2] == s[3] && s[1] != s[2] && s[4] != s[2])
-            || (s[3] == s[4] && s[2] != s[3] && s[5] != s[3])
-            || (s[4] == s[5] && s[3] != s[4])
-            )) {
-            continue;
+// Counts passwords with non-decreasing digits satisfying a rule, digit by digit
+// instead of number by number. A partial password is summed up by its last
+// digit, the length of its current run of that digit (0 before the first
+// non-zero digit, 3 meaning three or more) and whether an earlier run already
+// satisfied the rule. Counts for unbounded suffixes are memoized.
+class password_counter {
+private:
+    static const int MAX_DIGITS = 19;
+    rule _rule;
+    array<array<array<array<int64_t, 2>, 4>, 10>, MAX_DIGITS + 1> _memo;
+
+    bool closes(int run) const {
+        return _rule == ADJACENT_PAIR ? run >= 2 : run == 2;
+    }
+
+    bool step(int prev, int run, bool ok, int d, int &nprev, int &nrun, bool &nok) const {
+        if(run == 0) {
+            nprev = d;
+            nrun = d == 0 ? 0 : 1;
+            nok = ok;
+            return true;
+        }
+        if(d < prev) {
+            return false;
+        }
+        nprev = d;
+        nrun = d == prev ? min(run + 1, 3) : 1;
+        nok = ok || (d != prev && closes(run));
+        return true;
+    }
+
+    uint64_t finish(int run, bool ok) const {
+        return run != 0 && (ok || closes(run)) ? 1 : 0;
+    }
+
+    uint64_t unbounded(int remaining, int prev, int run, bool ok) {
+        if(remaining == 0) {
+            return finish(run, ok);
         }
-        if(s[5] < s[4] || s[4] < s[3] || s[3] < s[2] || s[2] < s[1] || s[1] < s[0]) {
-            continue;
+        auto &memo = _memo[remaining][prev][run][ok];
+        if(memo < 0) {
+            uint64_t total = 0;
+            for(int d = 0; d <= 9; d++) {
+                int nprev, nrun;
+                bool nok;
+                if(step(prev, run, ok, d, nprev, nrun, nok)) {
+                    total += unbounded(remaining - 1, nprev, nrun, nok);
+                }
+            }
+            memo = total;
         }
-        matches++;
+        return memo;
     }
 
-    cout << matches << endl;
+    // Passwords in [1, limit].
+    uint64_t count_upto(uint64_t limit) {
+        const auto digits = to_string(limit);
+        const int n = digits.size();
+        uint64_t total = 0;
+        int prev = 0, run = 0;
+        bool ok = false;
+        for(int i = 0; i < n; i++) {
+            const int bound = digits[i] - '0';
+            for(int d = 0; d < bound; d++) {
+                int nprev, nrun;
+                bool nok;
+                if(step(prev, run, ok, d, nprev, nrun, nok)) {
+                    total += unbounded(n - i - 1, nprev, nrun, nok);
+                }
+            }
+            if(!step(prev, run, ok, bound, prev, run, ok)) {
+                return total;
+            }
+        }
+        return total + finish(run, ok);
+    }
+
+public:
+    password_counter(rule r) : _rule(r) {
+        for(auto &a: _memo) for(auto &b: a) for(auto &c: b) c.fill(-1);
+    }
+
+    uint64_t count(uint64_t from, uint64_t to) {
+        if(from > to) {
+            return 0;
+        }
+        return count_upto(to) - (from > 0 ? count_upto(from - 1) : 0);
+    }
+};
+
+// Brute force reference for rules the counter can't express. 32 consecutive
+// candidates are held as one vector of digits per position and advanced with
+// a lane-wise carry, so the rules are checked for the whole block with
+// compares and masks instead of branches and strings.
+typedef uint8_t digit_lanes __attribute__((vector_size(32)));
+typedef int8_t mask_lanes __attribute__((vector_size(32)));
+static const int LANES = 32;
+
+// Adds `amount` to the number in `digits`, at most 4 carries per position.
+static void add_lanes(digit_lanes *digits, int n, digit_lanes amount) {
+    digit_lanes carry = amount;
+    for(int p = n - 1; p >= 0; p--) {
+        digit_lanes t = digits[p] + carry;
+        carry = digit_lanes{};
+        for(int k = 0; k < (p == n - 1 ? 4 : 1); k++) {
+            const auto over = (digit_lanes)(t >= 10);
+            t -= over & 10;
+            carry += over & 1;
+        }
+        digits[p] = t;
+    }
+}
+
+static mask_lanes check_lanes(const digit_lanes *digits, int n, rule r) {
+    const mask_lanes none = {};
+    mask_lanes ordered = ~none, found = none, before = none;
+    for(int p = 0; p + 1 < n; p++) {
+        ordered &= (mask_lanes)(digits[p] <= digits[p + 1]);
+        const auto equal = (mask_lanes)(digits[p] == digits[p + 1]);
+        const auto after = p + 2 < n ? (mask_lanes)(digits[p + 1] == digits[p + 2]) : none;
+        found |= r == ADJACENT_PAIR ? equal : (equal & ~before & ~after);
+        before = equal;
+    }
+    return ordered & found;
+}
+
+// Counts [from, to] where both have n digits.
+static uint64_t brute_force_block(uint64_t from, uint64_t to, int n, rule r) {
+    digit_lanes digits[20], lane, step;
+    for(int i = 0; i < LANES; i++) {
+        lane[i] = i;
+        step[i] = LANES;
+    }
+    auto value = from;
+    for(int p = n - 1; p >= 0; p--) {
+        digits[p] = digit_lanes{} + (uint8_t)(value % 10);
+        value /= 10;
+    }
+    add_lanes(digits, n, lane);
+
+    uint64_t total = 0;
+    digit_lanes counts = {};
+    int pending = 0;
+    for(auto base = from;; base += LANES) {
+        const auto remaining = (uint8_t)min<uint64_t>(to - base + 1, LANES);
+        const auto valid = check_lanes(digits, n, r) & (mask_lanes)(lane < remaining);
+        counts += (digit_lanes)valid & 1;
+        if(++pending == 255) {
+            for(int i = 0; i < LANES; i++) {
+                total += counts[i];
+            }
+            counts = digit_lanes{};
+            pending = 0;
+        }
+        if(to - base < LANES) {
+            break;
+        }
+        add_lanes(digits, n, step);
+    }
+    for(int i = 0; i < LANES; i++) {
+        total += counts[i];
+    }
+    return total;
+}
+
+uint64_t brute_force_count(uint64_t from, uint64_t to, rule r) {
+    if(from > to) {
+        return 0;
+    }
+    const uint64_t threads = max(1u, thread::hardware_concurrency());
+    vector<uint64_t> totals(threads);
+    vector<thread> workers;
+    for(uint64_t t = 0; t < threads; t++) {
+        workers.emplace_back([=, &totals]() {
+            const auto size = (unsigned __int128)(to - from) + 1;
+            const uint64_t lo = from + size * t / threads, end = size * (t + 1) / threads;
+            if(end == size * t / threads) {
+                return;
+            }
+            const uint64_t hi = from + (end - 1);
+            uint64_t first = 1;
+            for(int n = 1; n <= 20; n++, first *= 10) {
+                const auto last = n == 20 ? UINT64_MAX : first * 10 - 1;
+                const auto a = max(lo, first), b = min(hi, last);
+                if(a <= b) {
+                    totals[t] += brute_force_block(a, b, n, r);
+                }
+            }
+        });
+    }
+    uint64_t total = 0;
+    for(uint64_t t = 0; t < threads; t++) {
+        workers[t].join();
+        total += totals[t];
+    }
+    return total;
+}
+
+int main(int argc, char *argv[]) {
+    //264793-803935
+    uint64_t from = 264793, to = 803935;
+    const bool brute = argc > 1 && string(argv[1]) == "--brute";
+    if(argc > 2 + brute) {
+        from = stoull(argv[1 + brute]);
+        to = stoull(argv[2 + brute]);
+    }
+
+    for(auto r: {ADJACENT_PAIR, EXACT_PAIR}) {
+        auto start = chrono::steady_clock::now();
+        cout << password_counter(r).count(from, to) << endl;
+        if(brute) {
+            const chrono::duration<double, micro> counted = chrono::steady_clock::now() - start;
+            start = chrono::steady_clock::now();
+            const auto matches = brute_force_count(from, to, r);
+            const chrono::duration<double, micro> searched = chrono::steady_clock::now() - start;
+            cout << "brute force " << matches << " in " << searched.count() << "us, counted in "
+                << counted.count() << "us" << endl;
+        }
+    }
     cout << "Done!" << endl;
     return 0;
-}
\ No newline at end of file
+}
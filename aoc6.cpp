@@ -1,60 +1,487 @@
 #include <iostream>
 #include <fstream>
 #include <vector>
-#include <map>
-#include <functional>
+#include <string>
+#include <unordered_map>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
+#include <random>
 
 using namespace std;
 
-class Object {
+// Splits [0, count) into one contiguous chunk per core.
+template<typename F>
+void parallel_for(size_t count, F fn) {
+    const size_t threads = max(1u, thread::hardware_concurrency());
+    if(count < 4096 || threads == 1) {
+        fn(0, count);
+        return;
+    }
+    vector<thread> workers;
+    for(size_t t = 0; t < threads; t++) {
+        workers.emplace_back([&fn, count, threads, t]() {
+            fn(count * t / threads, count * (t + 1) / threads);
+        });
+    }
+    for(auto &worker: workers) {
+        worker.join();
+    }
+}
+
+// Orbit map with every object name interned to a dense id. Parents live in a
+// flat array (-1 for objects that orbit nothing) next to the computed depths.
+class OrbitMap {
+private:
+    unordered_map<string, int> _ids;
+    vector<string> _names;
+    vector<int> _parent, _depth;
+    mutable vector<vector<int>> _up;
+    mutable once_flag _up_built;
+
+    // Depths by pointer jumping: every object keeps a link and the number of
+    // levels it spans, each round doubles the links in parallel until they all
+    // run off a root, so it takes O(log depth) rounds and never recurses.
+    void compute_depths() {
+        const auto n = _parent.size();
+        vector<int> next = _parent, jumped(n);
+        _depth.resize(n);
+        parallel_for(n, [&](size_t begin, size_t end) {
+            for(auto obj = begin; obj < end; obj++) {
+                _depth[obj] = _parent[obj] == -1 ? 0 : 1;
+            }
+        });
+        vector<int> depth(n);
+        bool linked = true;
+        for(int round = 0; linked && round < 32; round++) {
+            atomic<bool> any(false);
+            parallel_for(n, [&](size_t begin, size_t end) {
+                bool local = false;
+                for(auto obj = begin; obj < end; obj++) {
+                    const auto link = next[obj];
+                    if(link == -1) {
+                        depth[obj] = _depth[obj];
+                        jumped[obj] = -1;
+                    } else {
+                        depth[obj] = _depth[obj] + _depth[link];
+                        jumped[obj] = next[link];
+                        local |= next[link] != -1;
+                    }
+                }
+                if(local) {
+                    any = true;
+                }
+            });
+            swap(_depth, depth);
+            swap(next, jumped);
+            linked = any;
+        }
+    }
+
+    // _up[k][obj] is the ancestor 2^k levels above obj, or -1. Built on the
+    // first ancestor query only, it takes O(n log depth) memory that a
+    // checksum does not need.
+    void build_ancestors() const {
+        int levels = 1;
+        for(auto depth: _depth) {
+            while((1 << levels) <= depth) {
+                levels++;
+            }
+        }
+        _up.assign(levels, vector<int>());
+        _up[0] = _parent;
+        for(int k = 1; k < levels; k++) {
+            const auto &half = _up[k - 1];
+            auto &up = _up[k];
+            up.resize(half.size());
+            parallel_for(half.size(), [&](size_t begin, size_t end) {
+                for(auto obj = begin; obj < end; obj++) {
+                    up[obj] = half[obj] == -1 ? -1 : half[half[obj]];
+                }
+            });
+        }
+    }
+
 public:
-    Object(string name, string parent): name(name), parent(parent) {
+    int intern(const string &name) {
+        auto [it, inserted] = _ids.try_emplace(name, (int)_names.size());
+        if(inserted) {
+            _names.push_back(name);
+            _parent.push_back(-1);
+        }
+        return it->second;
+    }
+
+    void load(const string filename) {
+        auto orbitmap = ifstream(filename);
+        string orbit;
+        while(getline(orbitmap, orbit)) {
+            const auto separator = orbit.find(')');
+            if(separator != string::npos) {
+                const auto parent = intern(orbit.substr(0, separator));
+                _parent[intern(orbit.substr(separator + 1))] = parent;
+            }
+        }
+        compute_depths();
+    }
+
+    int id(const string &name) const {
+        auto it = _ids.find(name);
+        return it == _ids.end() ? -1 : it->second;
+    }
+
+    const string &name(int obj) const {
+        return _names[obj];
+    }
+
+    int size() const {
+        return _names.size();
+    }
+
+    int parent(int obj) const {
+        return _parent[obj];
+    }
 
+    int depth(int obj) const {
+        return _depth[obj];
+    }
+
+    // Sum of direct and indirect orbits.
+    long long checksum() const {
+        long long total = 0;
+        for(auto depth: _depth) {
+            total += depth;
+        }
+        return total;
+    }
+
+    // Lowest common ancestor in O(log n), -1 if a and b are in different trees.
+    int common_ancestor(int a, int b) const {
+        call_once(_up_built, [this]() { build_ancestors(); });
+        if(_depth[a] < _depth[b]) {
+            swap(a, b);
+        }
+        for(int k = _up.size() - 1, diff = _depth[a] - _depth[b]; k >= 0; k--) {
+            if(diff & (1 << k)) {
+                a = _up[k][a];
+            }
+        }
+        if(a == b) {
+            return a;
+        }
+        for(int k = _up.size() - 1; k >= 0; k--) {
+            if(_up[k][a] != _up[k][b]) {
+                a = _up[k][a];
+                b = _up[k][b];
+            }
+        }
+        return _parent[a];
+    }
+
+    // Orbital transfers between a and b, -1 if they are not connected.
+    int distance(int a, int b) const {
+        const auto ancestor = common_ancestor(a, b);
+        return ancestor == -1 ? -1 : _depth[a] + _depth[b] - 2 * _depth[ancestor];
+    }
+
+    // Answers a batch of distance queries spread over all cores, unknown ids give -1.
+    vector<int> distances(const vector<pair<int, int>> &queries) const {
+        vector<int> results(queries.size());
+        parallel_for(queries.size(), [&](size_t begin, size_t end) {
+            for(auto i = begin; i < end; i++) {
+                const auto [a, b] = queries[i];
+                results[i] = a == -1 || b == -1 ? -1 : distance(a, b);
+            }
+        });
+        return results;
     }
-    string name;
-    string parent;
 };
 
-int depth(shared_ptr<Object> obj, map<string,shared_ptr<Object>> &objects) {
-    if(obj->parent == "COM") {
-        return 1;
+// Orbit map that can be edited in place. The forest is kept as an Euler tour,
+// +1 when an object is entered and -1 when it is left, stored in a treap keyed
+// by position. An object's subtree is then a contiguous run of the tour and
+// its depth is the prefix sum up to its entry. Every treap node also sums the
+// depths inside its range, so adding, removing or re-parenting an object with
+// everything orbiting it costs O(log n) and keeps the checksum up to date.
+class DynamicOrbitMap {
+private:
+    struct node {
+        int left = -1, right = -1, up = -1;
+        unsigned priority;
+        int value, size = 1;
+        long long sum, opens, depthsum;
+    };
+    vector<node> _nodes;
+    unordered_map<string, int> _ids;
+    vector<string> _names;
+    int _root = -1;
+    mt19937 _random;
+
+    // Each object has an entry token 2 * id and an exit token 2 * id + 1.
+    static int entry(int obj) { return 2 * obj; }
+    static int exit(int obj) { return 2 * obj + 1; }
+
+    int size(int t) const { return t == -1 ? 0 : _nodes[t].size; }
+    long long sum(int t) const { return t == -1 ? 0 : _nodes[t].sum; }
+    long long opens(int t) const { return t == -1 ? 0 : _nodes[t].opens; }
+    long long depthsum(int t) const { return t == -1 ? 0 : _nodes[t].depthsum; }
+
+    void update(int t) {
+        auto &n = _nodes[t];
+        const auto l = n.left, r = n.right;
+        n.size = size(l) + 1 + size(r);
+        n.sum = sum(l) + n.value + sum(r);
+        n.opens = opens(l) + (n.value > 0) + opens(r);
+        n.depthsum = depthsum(l) + (n.value > 0 ? sum(l) + n.value : 0)
+            + depthsum(r) + opens(r) * (sum(l) + n.value);
+        if(l != -1) _nodes[l].up = t;
+        if(r != -1) _nodes[r].up = t;
     }
-    return 1 + depth(objects[obj->parent], objects);
-}
 
-int find_in_path(shared_ptr<Object> source, map<string,shared_ptr<Object>> &objects, string name) {
-    if(source->parent == name) {
-        return 0;
+    int merge(int a, int b) {
+        if(a == -1 || b == -1) {
+            const auto t = a == -1 ? b : a;
+            if(t != -1) _nodes[t].up = -1;
+            return t;
+        }
+        if(_nodes[a].priority > _nodes[b].priority) {
+            _nodes[a].right = merge(_nodes[a].right, b);
+            update(a);
+            _nodes[a].up = -1;
+            return a;
+        }
+        _nodes[b].left = merge(a, _nodes[b].left);
+        update(b);
+        _nodes[b].up = -1;
+        return b;
     }
-    if(source->parent == "COM") {
-        return -1;
+
+    // Splits off the first k tokens of t into a.
+    void split(int t, int k, int &a, int &b) {
+        if(t == -1) {
+            a = b = -1;
+            return;
+        }
+        if(size(_nodes[t].left) < k) {
+            split(_nodes[t].right, k - size(_nodes[t].left) - 1, _nodes[t].right, b);
+            a = t;
+        } else {
+            split(_nodes[t].left, k, a, _nodes[t].left);
+            b = t;
+        }
+        update(t);
+        if(a != -1) _nodes[a].up = -1;
+        if(b != -1) _nodes[b].up = -1;
     }
-    int depth = find_in_path(objects[source->parent], objects, name);
-    return depth == -1 ? -1 : depth + 1;
-}
+
+    int position(int t) const {
+        int pos = size(_nodes[t].left);
+        for(int up = _nodes[t].up; up != -1; t = up, up = _nodes[t].up) {
+            if(_nodes[up].right == t) {
+                pos += size(_nodes[up].left) + 1;
+            }
+        }
+        return pos;
+    }
+
+    long long prefix(int t) const {
+        long long total = sum(_nodes[t].left) + _nodes[t].value;
+        for(int up = _nodes[t].up; up != -1; t = up, up = _nodes[t].up) {
+            if(_nodes[up].right == t) {
+                total += sum(_nodes[up].left) + _nodes[up].value;
+            }
+        }
+        return total;
+    }
+
+    int new_object(const string &name) {
+        const int obj = _names.size();
+        _ids[name] = obj;
+        _names.push_back(name);
+        for(int value: {1, -1}) {
+            node n;
+            n.priority = _random();
+            n.value = value;
+            n.sum = value;
+            n.opens = value > 0;
+            n.depthsum = value > 0 ? 1 : 0;
+            _nodes.push_back(n);
+        }
+        return obj;
+    }
+
+    // Inserts the tour `tour` right after obj's entry token.
+    void insert_under(int obj, int tour) {
+        int a, b;
+        split(_root, position(entry(obj)) + 1, a, b);
+        _root = merge(merge(a, tour), b);
+    }
+
+    // Cuts obj's subtree out of the tour and returns it.
+    int cut(int obj) {
+        const auto from = position(entry(obj)), to = position(exit(obj));
+        int a, b, c;
+        split(_root, to + 1, a, c);
+        split(a, from, a, b);
+        _root = merge(a, c);
+        return b;
+    }
+
+    void forget(int t) {
+        if(t == -1) {
+            return;
+        }
+        if(_nodes[t].value > 0) {
+            auto it = _ids.find(_names[t / 2]);
+            if(it != _ids.end() && it->second == t / 2) {
+                _ids.erase(it);
+            }
+        }
+        forget(_nodes[t].left);
+        forget(_nodes[t].right);
+    }
+
+    int find_or_add_root(const string &name) {
+        auto it = _ids.find(name);
+        if(it != _ids.end()) {
+            return it->second;
+        }
+        const auto obj = new_object(name);
+        _root = merge(_root, merge(entry(obj), exit(obj)));
+        return obj;
+    }
+
+public:
+    DynamicOrbitMap() : _random(6) {
+    }
+
+    explicit DynamicOrbitMap(const OrbitMap &orbits) : _random(6) {
+        vector<vector<int>> children(orbits.size());
+        vector<int> roots;
+        for(int obj = 0; obj < orbits.size(); obj++) {
+            new_object(orbits.name(obj));
+            if(orbits.parent(obj) == -1) {
+                roots.push_back(obj);
+            } else {
+                children[orbits.parent(obj)].push_back(obj);
+            }
+        }
+        vector<pair<int, size_t>> stack;
+        for(auto root: roots) {
+            stack.push_back({root, 0});
+            _root = merge(_root, entry(root));
+            while(!stack.empty()) {
+                auto &[obj, next] = stack.back();
+                if(next < children[obj].size()) {
+                    const auto child = children[obj][next++];
+                    _root = merge(_root, entry(child));
+                    stack.push_back({child, 0});
+                } else {
+                    _root = merge(_root, exit(obj));
+                    stack.pop_back();
+                }
+            }
+        }
+    }
+
+    long long checksum() const {
+        return depthsum(_root) - opens(_root);
+    }
+
+    int depth(const string &name) const {
+        auto it = _ids.find(name);
+        return it == _ids.end() ? -1 : prefix(entry(it->second)) - 1;
+    }
+
+    // Adds name orbiting parent, parent becomes a new root if it is unknown.
+    bool add(const string &name, const string &parent) {
+        if(_ids.count(name) > 0 || name == parent) {
+            return false;
+        }
+        const auto p = find_or_add_root(parent);
+        const auto obj = new_object(name);
+        insert_under(p, merge(entry(obj), exit(obj)));
+        return true;
+    }
+
+    // Removes name together with everything orbiting it.
+    bool remove(const string &name) {
+        auto it = _ids.find(name);
+        if(it == _ids.end()) {
+            return false;
+        }
+        forget(cut(it->second));
+        return true;
+    }
+
+    // Moves name and its satellites to orbit parent instead.
+    bool reparent(const string &name, const string &parent) {
+        auto it = _ids.find(name);
+        if(it == _ids.end()) {
+            return false;
+        }
+        const auto obj = it->second;
+        const auto p = find_or_add_root(parent);
+        const auto at = position(entry(p));
+        if(at >= position(entry(obj)) && at <= position(exit(obj))) {
+            return false;
+        }
+        insert_under(p, cut(obj));
+        return true;
+    }
+};
 
 int main(int argc, char *argv[]) {
-    auto objectmap = map<string,shared_ptr<Object>>();
-    auto orbitmap = ifstream("aoc6.txt");
-    string orbit;
-    while(getline(orbitmap, orbit)) {
-        auto object = make_shared<Object>(orbit.substr(4), orbit.substr(0, 3));
-        objectmap[object->name] = object;
-    }
-
-    auto you = objectmap["YOU"];
-    auto san = objectmap["SAN"];
-
-    auto obj = you;
-    int mydepth = 0;
-    while(obj->parent != "COM") {
-        auto depth = find_in_path(san, objectmap, obj->parent);
-        if(depth != -1) {
-            cout << "Found common parent " << obj->parent << " @ total depth " << depth + mydepth << endl;
-            break;
-        }
-        obj = objectmap[obj->parent];
-        mydepth++;
+    OrbitMap orbits;
+    orbits.load(argc > 1 ? argv[1] : "aoc6.txt");
+
+    // Optional file of edits, "+A)B" adds B around A, "-B" removes B with its
+    // satellites and "~A)B" moves B to orbit A. Prints the checksum after each.
+    if(argc > 3 && string(argv[2]) == "--edit") {
+        DynamicOrbitMap dynamic(orbits);
+        auto editfile = ifstream(argv[3]);
+        string edit;
+        while(getline(editfile, edit)) {
+            const auto separator = edit.find(')');
+            bool done = false;
+            if(edit[0] == '-') {
+                done = dynamic.remove(edit.substr(1));
+            } else if(separator != string::npos && (edit[0] == '+' || edit[0] == '~')) {
+                const auto parent = edit.substr(1, separator - 1), name = edit.substr(separator + 1);
+                done = edit[0] == '+' ? dynamic.add(name, parent) : dynamic.reparent(name, parent);
+            }
+            cout << edit << (done ? "" : " (ignored)") << " total orbits " << dynamic.checksum() << endl;
+        }
+        return 0;
+    }
+
+    // Optional file of "A B" lines, prints the transfers between each pair.
+    if(argc > 2) {
+        auto queryfile = ifstream(argv[2]);
+        vector<pair<int, int>> queries;
+        string a, b;
+        while(queryfile >> a >> b) {
+            queries.push_back({orbits.id(a), orbits.id(b)});
+        }
+        for(auto const d: orbits.distances(queries)) {
+            cout << d << endl;
+        }
+        return 0;
+    }
+
+    cout << "Total orbits " << orbits.checksum() << endl;
+
+    if(orbits.id("YOU") != -1 && orbits.id("SAN") != -1) {
+        const auto you = orbits.parent(orbits.id("YOU"));
+        const auto san = orbits.parent(orbits.id("SAN"));
+        const auto ancestor = you == -1 || san == -1 ? -1 : orbits.common_ancestor(you, san);
+        if(ancestor != -1) {
+            cout << "Found common parent " << orbits.name(ancestor)
+                << " @ total depth " << orbits.distance(you, san) << endl;
+        } else {
+            cout << "No common parent for YOU and SAN" << endl;
+        }
     }
 
     cout << "Done!" << endl;
@@ -5,68 +5,237 @@
 #include <map>
 #include <functional>
 #include <algorithm>
+#include <array>
+#include <climits>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace std;
 
-static const int width = 25;
-static const int height = 6;
-constexpr static const int pixels_per_layer() {
-    return width * height;
-};
-
-void read(vector<string> &pixels) {
-    auto imagefile = ifstream("aoc8.txt");
+// Pixels are kept as their digit values, one byte each.
+void read(const string filename, vector<uint8_t> &pixels) {
+    auto imagefile = ifstream(filename);
     string imageline;
     if(getline(imagefile, imageline)) {
-        for(int i=0;i<imageline.length();i++) {
-            pixels.push_back(imageline.substr(i, 1));
+        pixels.reserve(imageline.length());
+        for(const auto c: imageline) {
+            pixels.push_back(c - '0');
         }
     }
 }
 
-int main(int argc, char *argv[]) {
-    auto pixels = vector<string>();
-    read(pixels);
-
-    const int layers = pixels.size() / pixels_per_layer();
-    int least_zeroes_count = INT_MAX, 
-        least_zeroes_layer = -1, 
-        least_zeroes_ones = 0, 
-        least_zeroes_twos = 0;
-
-    for(int layer=0;layer<layers;layer++) {
-        const auto offset = layer * pixels_per_layer();
-        int zeroes = 0, ones = 0, twos = 0;
-        for(int i=0;i<pixels_per_layer();i++) {
-            const auto s = pixels[offset+i];
-            zeroes += count(s.begin(), s.end(), '0');
-            ones += count(s.begin(), s.end(), '1');
-            twos += count(s.begin(), s.end(), '2');
+typedef uint8_t pixel_lanes __attribute__((vector_size(32)));
+static const int LANES = sizeof(pixel_lanes);
+
+// Counts the 0, 1 and 2 pixels in one pass, 32 pixels per step. The per lane
+// byte counters are flushed before they can overflow.
+array<int, 3> histogram(const uint8_t *pixels, size_t count) {
+    array<int, 3> totals = {};
+    size_t i = 0;
+    while(i + LANES <= count) {
+        pixel_lanes zeroes = {}, ones = {}, twos = {};
+        for(int step = 0; step < 255 && i + LANES <= count; step++, i += LANES) {
+            pixel_lanes p;
+            memcpy(&p, pixels + i, LANES);
+            zeroes -= (pixel_lanes)(p == 0);
+            ones -= (pixel_lanes)(p == 1);
+            twos -= (pixel_lanes)(p == 2);
         }
-        if(zeroes < least_zeroes_count) {
-            least_zeroes_count = zeroes;
-            least_zeroes_layer = layer;
-            least_zeroes_ones = ones;
-            least_zeroes_twos = twos;
+        for(int lane = 0; lane < LANES; lane++) {
+            totals[0] += zeroes[lane];
+            totals[1] += ones[lane];
+            totals[2] += twos[lane];
         }
     }
+    for(; i < count; i++) {
+        totals[0] += pixels[i] == 0;
+        totals[1] += pixels[i] == 1;
+        totals[2] += pixels[i] == 2;
+    }
+    return totals;
+}
 
-    cout << least_zeroes_ones * least_zeroes_twos << endl;
+// Fills the still transparent (2) pixels of image from the layer below and
+// reports whether any pixel is left transparent.
+bool composite_layer(uint8_t *image, const uint8_t *layer, size_t count) {
+    pixel_lanes open = {};
+    size_t i = 0;
+    for(; i + LANES <= count; i += LANES) {
+        pixel_lanes top, below;
+        memcpy(&top, image + i, LANES);
+        memcpy(&below, layer + i, LANES);
+        const auto transparent = (pixel_lanes)(top == 2);
+        top = (top & ~transparent) | (below & transparent);
+        open |= (pixel_lanes)(top == 2);
+        memcpy(image + i, &top, LANES);
+    }
+    bool any = false;
+    for(; i < count; i++) {
+        if(image[i] == 2) {
+            image[i] = layer[i];
+        }
+        any |= image[i] == 2;
+    }
+    for(int lane = 0; lane < LANES; lane++) {
+        any |= open[lane] != 0;
+    }
+    return any;
+}
 
-   for(int y=0;y<height;y++) {
-        for(int x=0;x<width;x++) {
-            for(int layer=0;layer<layers;layer++) {
-                const auto pixel = pixels[(layer*pixels_per_layer()) + ((y *width)+x)];
-                if(pixel != "2") {
-                    cout << (pixel == "0" ? 'X' : ' ');
-                    break;
-                }
-            }
+struct DecodedImage {
+    int width = 0, height = 0;
+    int checksum = -1;          // ones * twos in the layer with fewest zeroes
+    vector<uint8_t> bitmap;     // composited pixels, row by row
+};
+
+// Takes an image one layer at a time, front to back. Only the running
+// composite and the best layer's counts are kept, and compositing stops at
+// the first layer that leaves no pixel transparent.
+class ImageDecoder {
+private:
+    DecodedImage _image;
+    size_t _pixels_per_layer;
+    int _least_zeroes_count = INT_MAX;
+    bool _open = true;
+
+public:
+    ImageDecoder(int width, int height) : _pixels_per_layer(width * height) {
+        _image.width = width;
+        _image.height = height;
+        _image.bitmap.assign(_pixels_per_layer, 2);
+    }
+
+    size_t pixels_per_layer() const {
+        return _pixels_per_layer;
+    }
+
+    void add_layer(const uint8_t *layer) {
+        const auto [zeroes, ones, twos] = histogram(layer, _pixels_per_layer);
+        if(zeroes < _least_zeroes_count) {
+            _least_zeroes_count = zeroes;
+            _image.checksum = ones * twos;
         }
-        cout << endl;
+        if(_open) {
+            _open = composite_layer(_image.bitmap.data(), layer, _pixels_per_layer);
+        }
+    }
+
+    DecodedImage finish() {
+        return move(_image);
     }
+};
 
+DecodedImage decode(const vector<uint8_t> &pixels, int width, int height) {
+    ImageDecoder decoder(width, height);
+    const auto pixels_per_layer = decoder.pixels_per_layer();
+    for(size_t offset = 0; pixels_per_layer > 0 && offset + pixels_per_layer <= pixels.size(); offset += pixels_per_layer) {
+        decoder.add_layer(pixels.data() + offset);
+    }
+    return decoder.finish();
+}
 
+// Decodes straight from a memory mapping of the file, converting one layer at
+// a time into a layer sized buffer and dropping the pages already consumed,
+// so memory stays O(width * height) however many layers there are. Falls back
+// to reading the whole file when it can't be mapped.
+DecodedImage decode_file(const string filename, int width, int height) {
+    struct stat st;
+    const auto fd = open(filename.c_str(), O_RDONLY);
+    if(fd == -1 || fstat(fd, &st) == -1 || st.st_size == 0) {
+        if(fd != -1) {
+            close(fd);
+        }
+        vector<uint8_t> pixels;
+        read(filename, pixels);
+        return decode(pixels, width, height);
+    }
+    auto data = static_cast<const char*>(mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0));
+    close(fd);
+    if(data == MAP_FAILED) {
+        vector<uint8_t> pixels;
+        read(filename, pixels);
+        return decode(pixels, width, height);
+    }
+    madvise(const_cast<char*>(data), st.st_size, MADV_SEQUENTIAL);
+
+    size_t size = st.st_size;
+    while(size > 0 && (data[size - 1] == '\n' || data[size - 1] == '\r')) {
+        size--;
+    }
+    ImageDecoder decoder(width, height);
+    const auto pixels_per_layer = decoder.pixels_per_layer();
+    const size_t release_every = 16 << 20;
+    size_t released = 0;
+    vector<uint8_t> layer(pixels_per_layer);
+    for(size_t offset = 0; pixels_per_layer > 0 && offset + pixels_per_layer <= size; offset += pixels_per_layer) {
+        for(size_t i = 0; i < pixels_per_layer; i++) {
+            layer[i] = data[offset + i] - '0';
+        }
+        decoder.add_layer(layer.data());
+        if(offset - released >= release_every) {
+            const auto page = (size_t)sysconf(_SC_PAGESIZE);
+            const auto upto = offset / page * page;
+            madvise(const_cast<char*>(data) + released, upto - released, MADV_DONTNEED);
+            released = upto;
+        }
+    }
+    munmap(const_cast<char*>(data), st.st_size);
+    return decoder.finish();
+}
+
+// Decodes every file, spreading the files over all cores.
+vector<DecodedImage> decode_files(const vector<string> &filenames, int width, int height) {
+    vector<DecodedImage> images(filenames.size());
+    atomic<size_t> next(0);
+    vector<thread> workers;
+    const auto threads = min<size_t>(max(1u, thread::hardware_concurrency()), filenames.size());
+    for(size_t t = 0; t < threads; t++) {
+        workers.emplace_back([&]() {
+            for(auto i = next++; i < filenames.size(); i = next++) {
+                images[i] = decode_file(filenames[i], width, height);
+            }
+        });
+    }
+    for(auto &worker: workers) {
+        worker.join();
+    }
+    return images;
+}
+
+int main(int argc, char *argv[]) {
+    int width = 25, height = 6;
+    vector<string> filenames;
+    if(argc > 2) {
+        width = stoi(argv[1]);
+        height = stoi(argv[2]);
+    }
+    for(int i = 3; i < argc; i++) {
+        filenames.push_back(argv[i]);
+    }
+    if(filenames.empty()) {
+        filenames.push_back("aoc8.txt");
+    }
+
+    const auto images = decode_files(filenames, width, height);
+    for(size_t i = 0; i < images.size(); i++) {
+        const auto &image = images[i];
+        if(images.size() > 1) {
+            cout << filenames[i] << endl;
+        }
+        cout << image.checksum << endl;
+        for(int y=0;y<image.height && image.checksum != -1;y++) {
+            for(int x=0;x<image.width;x++) {
+                cout << (image.bitmap[(y * image.width) + x] == 0 ? 'X' : ' ');
+            }
+            cout << endl;
+        }
+    }
 
     cout << "Done!" << endl;
     return 0;